@@ -0,0 +1,214 @@
+#include "bmp/include.h"
+#include <chrono>
+#include <string>
+
+/*
+benchmarks for the drawing, geometry and I/O hot paths
+
+    bench [quick] > result.json
+
+prints one JSON object with a "results" array; every entry has the name
+of the measured call, the case (canvas size, radius, file, depth), the
+time per call and the rate that matters for it: ns per pixel, ns per
+vertex or MB/s. Each case repeats until it has run for at least 0.2 s
+(0.05 s with `quick`, which also stops splitting at depth 4).
+*/
+
+// bpt/ as shipped; there is no portable directory listing before C++17
+const char *MODELS[] = {
+    "teacup.bpt", "teacup2.bpt", "teapot.bpt", "teapotCGA.bpt", "teapotCGAnobottom.bpt",
+    "teapotCGAnobottomtall.bpt", "teapotCGAtall.bpt", "teapotrim.bpt", "teaspoon.bpt", "u.bpt"
+};
+const int SIZES[][2] = { { 320, 240 }, { 640, 480 }, { 1280, 720 }, { 1920, 1080 } }; // up to the 2073600 pixel limit
+
+double minTime = 0.2;
+int maxSplit = 6;
+bool first = true;
+
+double now() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// run f until minTime has passed, seconds per call
+template<class F>
+double measure(F f) {
+    int n = 0;
+    double start = now(), t;
+    do {
+        f();
+        n++;
+    } while((t = now() - start) < minTime);
+    return t / n;
+}
+
+// as above, with setup run before every call and left out of the time
+template<class S, class F>
+double measure(S setup, F f) {
+    int n = 0;
+    double t = 0;
+    do {
+        setup();
+        double start = now();
+        f();
+        t += now() - start;
+        n++;
+    } while(t < minTime);
+    return t / n;
+}
+
+// one JSON result: unit is "ns_per_pixel", "ns_per_vertex" or "mb_per_s"
+void report(string name, string which, double seconds, const char *unit, double amount) {
+    double rate = string(unit) == "mb_per_s" ? amount / 1e6 / seconds : seconds * 1e9 / amount;
+    printf("%s\n    {\"name\": \"%s\", \"case\": \"%s\", \"ms\": %.6f, \"%s\": %.4f}",
+        first ? "" : ",", name.c_str(), which.c_str(), seconds * 1e3, unit, rate);
+    first = false;
+}
+
+string sizeName(int w, int h) {
+    char s[32];
+    sprintf(s, "%dx%d", w, h);
+    return s;
+}
+
+int vertices(BezObj& obj) {
+    int n = 0;
+    for(int i = 0; i < int(obj.data.size()); i++)
+        for(int j = 0; j < int(obj.data[i].size()); j++)
+            n += obj.data[i][j].size();
+    return n;
+}
+
+void benchDrawing(int w, int h) {
+    string which = sizeName(w, h);
+    Bitmap bmp(w, h);
+    // lines across the canvas in every direction
+    vector<P2P> lines;
+    double pixels = 0;
+    for(int i = 0; i < 64; i++) {
+        double a = i * 2 * 3.14159265 / 64, r = h * 0.45;
+        P2 p1(-cos(a) * r, -sin(a) * r), p2(cos(a) * r, sin(a) * r);
+        lines.push_back(P2P(p1, p2));
+        pixels += max(fabs(p2.x - p1.x), fabs(p2.y - p1.y)) + 1;
+    }
+    report("Bitmap::line", which, measure([&] {
+        for(int i = 0; i < int(lines.size()); i++)
+            bmp.line(lines[i]);
+    }), "ns_per_pixel", pixels);
+    bmp.setAntialias(true);
+    report("Bitmap::line antialiased", which, measure([&] {
+        for(int i = 0; i < int(lines.size()); i++)
+            bmp.line(lines[i]);
+    }), "ns_per_pixel", pixels * 2);
+    bmp.setAntialias(false);
+    // triangle over a quarter of the canvas
+    P2 t1(-w * 0.25, -h * 0.25), t2(w * 0.25, -h * 0.25), t3(0.0, h * 0.25);
+    double area = fabs(det(t2 - t1, t3 - t1)) / 2;
+    report("Bitmap::sTriangle", which, measure([&] { bmp.sTriangle(t1, t2, t3); }), "ns_per_pixel", area);
+    bmp.setMSAA(4);
+    report("Bitmap::sTriangle msaa4", which, measure([&] { bmp.sTriangle(t1, t2, t3); }), "ns_per_pixel", area);
+    bmp.setMSAA(1);
+    double r = h * 0.25;
+    report("Bitmap::ball", which, measure([&] { bmp.ball(P2(0, 0), r); }), "ns_per_pixel", 3.14159265 * r * r);
+    report("Bitmap::ball r=3", which, measure([&] { bmp.ball(P2(0, 0), 3.0); }), "ns_per_pixel", 3.14159265 * 9);
+    report("Bitmap::circle", which, measure([&] { bmp.circle(P2(0, 0), r); }), "ns_per_pixel", 2 * 3.14159265 * r);
+    report("Bitmap::circle r=3", which, measure([&] { bmp.circle(P2(0, 0), 3.0); }), "ns_per_pixel", 2 * 3.14159265 * 3);
+}
+
+void benchBlur(int w, int h) {
+    Bitmap bmp(w, h);
+    for(int y = 0; y < h; y++)
+        for(int x = 0; x < w; x++)
+            bmp.row(y)[x] = RGB((unsigned char)(x * 7), (unsigned char)(y * 3), (unsigned char)(x ^ y));
+    ImageProcessor ip(&bmp);
+    int radii[] = { 1, 2, 4, 8, 16 };
+    for(int i = 0; i < 5; i++) {
+        char which[48];
+        sprintf(which, "%s r=%d", sizeName(w, h).c_str(), radii[i]);
+        report("ImageProcessor::GaussianBlur", which, measure([&] { ip.GaussianBlur(radii[i]); }), "ns_per_pixel", double(w) * h);
+    }
+}
+
+void benchIO(int w, int h) {
+    string which = sizeName(w, h);
+    const char *name = "bench.tmp.bmp";
+    Bitmap bmp(w, h);
+    double bytes = double(w) * h * 3 + 54;
+    report("Bitmap::save", which, measure([&] { bmp.save(name); }), "mb_per_s", bytes);
+    report("Bitmap::load", which, measure([&] { bmp.load(name); }), "mb_per_s", bytes);
+    remove(name);
+}
+
+void benchModel(const char *file) {
+    string path = string("bpt/") + file;
+    BezObj obj(path.c_str());
+    if(obj.data.empty())
+        return;
+    ifstream in(path.c_str(), ios::binary | ios::ate);
+    double size = double(in.tellg());
+    int v = vertices(obj);
+    report("BezObj::load", file, measure([&] { obj.load(path.c_str()); }), "ns_per_vertex", v);
+    report("BezObj::load MB/s", file, measure([&] { obj.load(path.c_str()); }), "mb_per_s", size);
+    for(int n = 1; n <= maxSplit; n++) {
+        char which[64];
+        sprintf(which, "%s split(%d)", file, n);
+        BezObj split;
+        double t = measure([&] { split = obj; }, [&] { split.split(n); });
+        report("BezObj::split", which, t, "ns_per_vertex", vertices(split));
+    }
+}
+
+// camera shots (and once, rotations) of every object type, from the teapot at split(2)
+void benchScene(int w, int h, bool rotations) {
+    BezObj bez("bpt/teapotCGAtall.bpt");
+    bez.split(2);
+    bez.move(P3(0, -100, -1000));
+    LinObj lin;
+    TriObj tri;
+    for(int i = 0; i < int(bez.data.size()); i++)
+        for(int j = 0; j + 1 < 4; j++)
+            for(int k = 0; k + 1 < 4; k++) {
+                P3 a = bez.data[i][j][k] * bez.scale, b = bez.data[i][j][k + 1] * bez.scale;
+                P3 c = bez.data[i][j + 1][k] * bez.scale, d = bez.data[i][j + 1][k + 1] * bez.scale;
+                lin.addLine(a, b), lin.addLine(a, c);
+                tri.addTriangle(a, b, c), tri.addTriangle(b, d, c);
+            }
+    lin.move(bez.middle), tri.move(bez.middle);
+    tri.scale = 1;
+    int v = vertices(bez);
+    if(rotations) {
+        report("BezObj::rotateX", "teapotCGAtall split(2)", measure([&] { bez.rotateX(1); }), "ns_per_vertex", v);
+        report("BezObj::rotateY", "teapotCGAtall split(2)", measure([&] { bez.rotateY(1); }), "ns_per_vertex", v);
+        report("BezObj::rotateZ", "teapotCGAtall split(2)", measure([&] { bez.rotateZ(1); }), "ns_per_vertex", v);
+        report("LinObj::rotateX", "teapotCGAtall split(2)", measure([&] { lin.rotateX(1); }), "ns_per_vertex", lin.vs.size() * 2.0);
+        report("LinObj::rotateY", "teapotCGAtall split(2)", measure([&] { lin.rotateY(1); }), "ns_per_vertex", lin.vs.size() * 2.0);
+        report("LinObj::rotateZ", "teapotCGAtall split(2)", measure([&] { lin.rotateZ(1); }), "ns_per_vertex", lin.vs.size() * 2.0);
+        report("TriObj::rotateX", "teapotCGAtall split(2)", measure([&] { tri.rotateX(1); }), "ns_per_vertex", tri.vs.size() * 3.0);
+        report("TriObj::rotateY", "teapotCGAtall split(2)", measure([&] { tri.rotateY(1); }), "ns_per_vertex", tri.vs.size() * 3.0);
+        report("TriObj::rotateZ", "teapotCGAtall split(2)", measure([&] { tri.rotateZ(1); }), "ns_per_vertex", tri.vs.size() * 3.0);
+    }
+    Bitmap bmp(w, h);
+    Camera cam;
+    cam.zoom = 1, cam.focus = 10000, cam.height = 100;
+    string which = sizeName(w, h);
+    report("Camera::shot BezObj", which, measure([&] { cam.shot(bez, bmp); }), "ns_per_vertex", v);
+    report("Camera::shot LinObj", which, measure([&] { cam.shot(lin, bmp); }), "ns_per_vertex", lin.vs.size() * 2.0);
+    report("Camera::shot TriObj", which, measure([&] { cam.shot(tri, bmp, false); }), "ns_per_vertex", tri.vs.size() * 3.0);
+    report("Camera::shot TriObj solid", which, measure([&] { cam.shot(tri, bmp, true); }), "ns_per_vertex", tri.vs.size() * 3.0);
+}
+
+int main(int argc, char **argv) {
+    if(argc > 1 && string(argv[1]) == "quick")
+        minTime = 0.05, maxSplit = 4;
+    printf("{\n  \"min_seconds\": %g,\n  \"results\": [", minTime);
+    for(int i = 0; i < 4; i++) {
+        benchDrawing(SIZES[i][0], SIZES[i][1]);
+        benchBlur(SIZES[i][0], SIZES[i][1]);
+        benchIO(SIZES[i][0], SIZES[i][1]);
+    }
+    for(int i = 0; i < int(sizeof(MODELS) / sizeof(MODELS[0])); i++)
+        benchModel(MODELS[i]);
+    for(int i = 0; i < 4; i++)
+        benchScene(SIZES[i][0], SIZES[i][1], i == 0);
+    printf("\n  ]\n}\n");
+    return 0;
+}
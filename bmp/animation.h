@@ -0,0 +1,215 @@
+#ifndef __ANIMATION_H__
+#define __ANIMATION_H__
+
+#include <vector>
+#include <future>
+#include <chrono>
+#include "bitmap.h"
+#include "object.h"
+#include "camera.h"
+#include "sink.h"
+#include "arena.h"
+using namespace std;
+
+/*
+Keyframe
+
+pose of the model and the camera at one frame; frames between two keys
+are interpolated linearly, so a rotation from 0 to 360 is one full turn
+*/
+struct Keyframe {
+    int frame;
+    P3 rotate;                  // degrees, applied about z, then x, then y
+    P3 move;
+    double zoom, focus, height; // Camera
+    Keyframe();
+    Keyframe(int frame, P3 rotate, P3 move, Camera cam);
+};
+
+/*
+Animation
+
+renders a keyframed sequence of one model: the model is kept once and
+every frame tessellates it into a per-frame arena, which is reset
+between frames, and transforms that copy; two frame buffers take turns,
+so frame n + 1 is drawn while frame n is written out on another thread,
+to any FrameSink (numbered BMPs, a raw BGR24 or Y4M stream). After the
+first frame the arena is a single block and drawing allocates nothing.
+*/
+class Animation {
+public:
+    vector<Keyframe> keys;          // in frame order
+    int frames;                     // frames rendered, 0 .. frames - 1
+    RGB color, background;
+    bool antialias;
+    int depth;                      // further splits every frame, 0
+    Precision precision;            // of the points projected and rasterized, DOUBLE
+    double renderMs, encodeMs, waitMs;  // of the last run: drawing, writing, render waiting for the writer
+
+    Animation(const BezObj& model, int width, int height); // bicubic patches, as they should be drawn or split less deep
+    void addKey(Keyframe key);
+    void turntable(int frames, double tilt, P3 move, Camera cam);   // one turn about z in `frames` frames
+    Keyframe at(int frame);         // interpolated pose
+    void draw(int frame, Bitmap& bmp);
+    bool render(FrameSink& sink);               // every frame, in order
+    bool renderFrames(const char *pattern);     // BmpSink, "f%04d.bmp"
+    bool renderStream(const char *name);        // RawSink, "-" for stdout
+private:
+    BezObj base;
+    Arena arena;                    // the frame being drawn
+    Bitmap buffers[2];
+    Camera camera;
+    template<class T> void drawPoints(Keyframe& k, Bitmap& bmp);   // tessellate, transform and shoot in T
+};
+
+
+/******************************************************************************/
+//  Keyframe Member Functions
+/******************************************************************************/
+
+Keyframe::Keyframe() {
+    Camera cam;
+    *this = Keyframe(0, P3(0, 0, 0), P3(0, 0, 0), cam);
+}
+
+Keyframe::Keyframe(int frame, P3 rotate, P3 move, Camera cam) {
+    this->frame = frame;
+    this->rotate = rotate, this->move = move;
+    zoom = cam.zoom, focus = cam.focus, height = cam.height;
+}
+
+
+/******************************************************************************/
+//  Animation Member Functions
+/******************************************************************************/
+
+// bicubic patches (every .bpt here), as they should be drawn or split less deep
+Animation::Animation(const BezObj& model, int width, int height) {
+    base = model;
+    frames = 0;
+    color = RGB(255, 255, 255), background = RGB(0, 0, 0);
+    antialias = false;
+    depth = 0;
+    precision = DOUBLE;
+    renderMs = encodeMs = waitMs = 0;
+    buffers[0].setSize(width, height);
+    buffers[1].setSize(width, height);
+}
+
+void Animation::addKey(Keyframe key) {
+    int i = keys.size();
+    while(i > 0 && keys[i - 1].frame > key.frame)
+        i--;
+    keys.insert(keys.begin() + i, key);
+    frames = max(frames, key.frame + 1);
+}
+
+// one turn about z in `frames` frames, tilted about x
+// the last key is the first pose again, one frame past the end
+void Animation::turntable(int frames, double tilt, P3 move, Camera cam) {
+    keys.clear();
+    addKey(Keyframe(0, P3(tilt, 0.0, 0.0), move, cam));
+    addKey(Keyframe(frames, P3(tilt, 0.0, 360.0), move, cam));
+    this->frames = frames;
+}
+
+// interpolated pose
+Keyframe Animation::at(int frame) {
+    if(keys.empty())
+        return Keyframe();
+    if(frame <= keys[0].frame)
+        return keys[0];
+    if(frame >= keys.back().frame)
+        return keys.back();
+    int i = 1;
+    while(keys[i].frame <= frame)
+        i++;
+    Keyframe a = keys[i - 1], b = keys[i];
+    double t = double(frame - a.frame) / (b.frame - a.frame);
+    Keyframe k = a;
+    k.frame = frame;
+    k.rotate = a.rotate + (b.rotate - a.rotate) * t;
+    k.move = a.move + (b.move - a.move) * t;
+    k.zoom = a.zoom + (b.zoom - a.zoom) * t;
+    k.focus = a.focus + (b.focus - a.focus) * t;
+    k.height = a.height + (b.height - a.height) * t;
+    return k;
+}
+
+void Animation::draw(int frame, Bitmap& bmp) {
+    Keyframe k = at(frame);
+    arena.reset();
+    camera.zoom = k.zoom, camera.focus = k.focus, camera.height = k.height;
+    bmp.set(background);
+    bmp.setColor(color);
+    bmp.setAntialias(antialias);
+    if(precision == FLOAT)
+        drawPoints<float>(k, bmp);
+    else if(precision == FIXED)
+        drawPoints<Fixed>(k, bmp);
+    else
+        drawPoints<double>(k, bmp);
+}
+
+// tessellate, transform and shoot in T
+template<class T>
+void Animation::drawPoints(Keyframe& k, Bitmap& bmp) {
+    ArenaVector< Point3<T> > points(arena);
+    base.tessellate(depth, points, 1);
+    for(size_t i = 0; i < points.size(); i++) {
+        if(k.rotate.z != 0)
+            rotateZ(points[i], k.rotate.z);
+        if(k.rotate.x != 0)
+            rotateX(points[i], k.rotate.x);
+        if(k.rotate.y != 0)
+            rotateY(points[i], k.rotate.y);
+    }
+    camera.shot(points.data(), points.size() / 16, base.scale, Point3<T>(base.middle + k.move), bmp);
+}
+
+// BmpSink, "f%04d.bmp"
+bool Animation::renderFrames(const char *pattern) {
+    BmpSink sink(pattern);
+    return render(sink);
+}
+
+// RawSink, "-" for stdout
+bool Animation::renderStream(const char *name) {
+    RawSink sink(name);
+    return sink.isOpen() && render(sink) && sink.close();
+}
+
+// frame n is drawn into buffer n % 2 while the writer still has frame
+// n - 1; before the writer gets frame n it must be done with n - 1,
+// which also frees buffer (n + 1) % 2 for the next frame
+bool Animation::render(FrameSink& sink) {
+    typedef chrono::steady_clock clock;
+    renderMs = encodeMs = waitMs = 0;
+    future<bool> writing;
+    double writeMs = 0;             // of the frame being written, read after get()
+    bool ok = true;
+    for(int n = 0; n < frames && ok; n++) {
+        Bitmap &bmp = buffers[n % 2];
+        clock::time_point t0 = clock::now();
+        draw(n, bmp);
+        clock::time_point t1 = clock::now();
+        renderMs += chrono::duration<double, milli>(t1 - t0).count();
+        if(writing.valid()) {
+            ok = writing.get(), encodeMs += writeMs;
+            waitMs += chrono::duration<double, milli>(clock::now() - t1).count();
+        }
+        if(ok)
+            writing = async(launch::async, [&sink, &bmp, &writeMs] {
+                clock::time_point start = clock::now();
+                bool done = sink.write(bmp);
+                writeMs = chrono::duration<double, milli>(clock::now() - start).count();
+                return done;
+            });
+    }
+    if(writing.valid())
+        ok = writing.get() && ok, encodeMs += writeMs;
+    return ok;
+}
+
+
+#endif /* __ANIMATION_H__ */
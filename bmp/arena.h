@@ -0,0 +1,151 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <vector>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+using namespace std;
+
+/*
+Arena
+
+bump allocator for memory that lives exactly as long as one frame:
+tessellated patches, projected vertex arrays, polygon edge lists.
+allocate() moves a pointer forward, nothing is freed on its own, and
+reset() hands everything back at once.
+
+    Arena arena;
+    for(each frame) {
+        arena.reset();
+        ArenaVector<P3> points(arena);
+        ...
+    }
+
+when a frame needs more than the current block another one is added;
+reset() then replaces all of them with a single block of their total
+size, so from the second frame on a frame of the same size costs no
+malloc at all. Not thread safe: one arena per thread.
+*/
+class Arena {
+public:
+    Arena(size_t block);                    // first block, allocated on first use
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    void *allocate(size_t bytes, size_t align);
+    void reset();                           // everything allocated so far is gone
+    size_t used();                          // bytes handed out since the last reset
+    size_t capacity();                      // bytes held in blocks
+    int getBlocks();                        // blocks held; 1 in the steady state
+private:
+    struct Block {
+        char *data;
+        size_t size;
+    };
+    vector<Block> blocks;
+    size_t block, top, done;                // next block size, offset in the last block, bytes in the blocks before it
+    void grow(size_t bytes, size_t align);
+};
+
+/*
+ArenaAllocator
+
+STL allocator on top of an Arena; deallocate does nothing, so a vector
+that grows leaves its old buffers in the arena until reset(): reserve
+when the size is known
+*/
+template<class T>
+struct ArenaAllocator {
+    typedef T value_type;
+    Arena *arena;
+    ArenaAllocator(Arena& arena) : arena(&arena) {}
+    template<class U> ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+    T *allocate(size_t n) { return (T*)arena->allocate(n * sizeof(T), alignof(T)); }
+    void deallocate(T*, size_t) {}
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+// vector in an arena, ArenaVector<P2> v(arena);
+template<class T>
+using ArenaVector = vector<T, ArenaAllocator<T> >;
+
+
+/******************************************************************************/
+//  Arena Member Functions
+/******************************************************************************/
+
+// first block, allocated on first use
+Arena::Arena(size_t block = 64 << 10) {
+    this->block = max(block, size_t(64));
+    top = done = 0;
+}
+
+Arena::~Arena() {
+    for(int i = 0; i < int(blocks.size()); i++)
+        free(blocks[i].data);
+}
+
+void *Arena::allocate(size_t bytes, size_t align = alignof(max_align_t)) {
+    size_t at = blocks.empty() ? 0 : (top + align - 1) & ~(align - 1);
+    if(blocks.empty() || at + bytes > blocks.back().size) {
+        grow(bytes, align);
+        at = 0;
+    }
+    top = at + bytes;
+    return blocks.back().data + at;
+}
+
+// a block of at least twice the last, big enough for the request; malloc
+// aligns it for anything, so offset 0 always fits
+void Arena::grow(size_t bytes, size_t align) {
+    if(!blocks.empty())
+        done += top;
+    size_t size = max(block, bytes + align);
+    char *data = (char*)malloc(size);
+    if(!data)
+        throw bad_alloc();
+    Block b = { data, size };
+    blocks.push_back(b);
+    block = size * 2;
+    top = 0;
+}
+
+// everything allocated so far is gone; several blocks become one of
+// their total size
+void Arena::reset() {
+    if(blocks.size() > 1) {
+        size_t total = capacity();
+        for(int i = 0; i < int(blocks.size()); i++)
+            free(blocks[i].data);
+        blocks.clear();
+        block = total;
+        grow(total - alignof(max_align_t), alignof(max_align_t));
+    }
+    top = done = 0;
+}
+
+// bytes handed out since the last reset, alignment included
+size_t Arena::used() {
+    return done + top;
+}
+
+size_t Arena::capacity() {
+    size_t total = 0;
+    for(int i = 0; i < int(blocks.size()); i++)
+        total += blocks[i].size;
+    return total;
+}
+
+// 1 in the steady state
+int Arena::getBlocks() {
+    return blocks.size();
+}
+
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,483 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include "bitmap.h"
+#include "object.h"
+#include "camera.h"
+#include "processor.h"
+#include "taskgraph.h"
+using namespace std;
+
+/*
+batch rendering
+
+a job file holds one render per line as `key=value` words; rotations
+and filters run in the order they are written, `#` starts a comment
+
+    model=bpt/teapotCGAtall.bpt out=output/teapot.bmp split=2 rotz=-45 rotx=-45
+        move=0,-100,-1000 height=100 aa blur=1          (one line)
+
+    model=FILE              .bpt model (required)
+    out=FILE                output bitmap (required)
+    size=WxH                canvas, 640x480
+    split=N                 subdivision depth 0..6, 0
+    rotx= roty= rotz=DEG    rotation about the model's own origin
+    move=X,Y,Z              translation, 0,0,0
+    scale=S                 model scale, 100
+    zoom= focus= height=    camera, 1 10000 1000
+    eye=X,Y,Z               ViewCamera at eye instead, looking at
+    target=X,Y,Z up=X,Y,Z       target, 0,0,0, with up, 0,1,0 (another axis
+                                if it is the line of sight)
+    fov=DEG ortho=SPAN near=N   perspective, 45, or orthographic lens; near plane, 1
+    color=R,G,B             pen, 255,255,255
+    background=R,G,B        0,0,0
+    aa                      anti-aliased lines
+    blur=R sharpen emboss sobel grayscale pixelate=N unsharp=R,AMOUNT
+*/
+struct PostFilter {
+    string name;
+    double a, b;
+};
+
+struct RenderJob {
+    int line;                               // in the job file
+    string model, out;
+    int width, height, depth;
+    vector< pair<char, double> > rotations; // axis, degrees
+    P3 move;
+    double scale;
+    Camera camera;
+    bool view;                              // eye= given: ViewCamera, the cached model is not copied
+    P3 eye, target, up;
+    double fov, span, near;                 // span > 0: orthographic
+    RGB color, background;
+    bool antialias;
+    vector<PostFilter> filters;
+    // filled in by BatchRenderer
+    bool ok;
+    string error;
+    double loadMs, renderMs, filterMs, saveMs, totalMs;
+
+    RenderJob();
+    bool parse(const string& text, string& error);  // one line of a job file
+};
+
+bool readJobs(const char *name, vector<RenderJob>& jobs, string& error);   // every job of a file, or the first error
+
+/*
+ModelCache
+
+every model is read once and every split depth of it made once, however
+many jobs ask for it at the same time; jobs copy the shared control
+points and transform their copy. Rotation and move are affine, so
+splitting before them draws the same surface as splitting after.
+
+the cache holds at most maxPatches patches: past that the least recently
+asked for models go first. A job keeps what it was given alive until it
+lets go, so eviction never pulls a model from under a running job. A
+file that cannot be read is not kept, and the next job tries again.
+*/
+class ModelCache {
+public:
+    size_t maxPatches;                                  // 1 << 18, a depth-6 teapot is 131072
+
+    ModelCache();
+    shared_ptr<const BezObj> get(const string& path, int depth);   // empty if the file could not be read
+    size_t size();                                      // models and depths held
+    void clear();                                       // drop everything not in use
+private:
+    struct Entry {
+        once_flag once;
+        BezObj obj;
+        bool ready = false;
+        unsigned long long used = 0;                    // tick of the last get()
+    };
+    mutex lock;
+    map< pair<string, int>, shared_ptr<Entry> > entries;
+    unsigned long long tick;
+    void trim();                                        // evict down to maxPatches, lock held
+};
+
+/*
+BatchRenderer
+
+every job is a chain of four stages on a TaskGraph, so the stages of
+different jobs overlap: one job draws while the next gets its model and
+the one before is filtered or written
+
+    model       cached load and split, then rotate and move
+    shot        canvas and Camera::shot
+    filter      post-processing
+    save        the bitmap, then the job's memory is freed
+
+about two jobs per worker are in flight at a time
+*/
+class BatchRenderer {
+public:
+    ModelCache models;
+    bool deterministic;                     // every stage on the calling thread, in a fixed order
+
+    BatchRenderer(int threads);             // 0: one per hardware thread
+    void run(vector<RenderJob>& jobs);
+    void render(RenderJob& job);            // one job, every stage on the calling thread
+    int getThreads();
+private:
+    typedef chrono::steady_clock clock;
+    struct Work {                           // a job between two stages
+        BezObj obj;
+        shared_ptr<const BezObj> cached;    // held for a ViewCamera until the job is saved
+        const BezObj *model;                // obj, or the cached model for a ViewCamera
+        Bitmap bmp;
+        clock::time_point start;
+    };
+    int threads;
+    void model(RenderJob& job, Work& work);
+    void shot(RenderJob& job, Work& work);
+    void filter(RenderJob& job, Work& work);
+    void save(RenderJob& job, Work& work);
+};
+
+/******************************************************************************/
+//  RenderJob Member Functions
+/******************************************************************************/
+
+RenderJob::RenderJob() {
+    line = 0;
+    width = 640, height = 480, depth = 0;
+    view = false;
+    eye = P3(0, 0, 1000), target = P3(0, 0, 0), up = P3(0, 1, 0);
+    fov = 45, span = 0, near = 1;
+    move = P3(0, 0, 0);
+    scale = 100;
+    color = RGB(255, 255, 255), background = RGB(0, 0, 0);
+    antialias = false;
+    ok = false;
+    loadMs = renderMs = filterMs = saveMs = totalMs = 0;
+}
+
+// one line of a job file
+bool RenderJob::parse(const string& text, string& error) {
+    istringstream words(text.substr(0, text.find('#')));
+    string word;
+    while(words >> word) {
+        size_t eq = word.find('=');
+        string key = word.substr(0, eq), value = eq == string::npos ? "" : word.substr(eq + 1);
+        const char *v = value.c_str();
+        double a = 0, b = 0;
+        int R, G, B;
+        bool good = true;
+        if(key == "model")
+            model = value, good = !value.empty();
+        else if(key == "out")
+            out = value, good = !value.empty();
+        else if(key == "size")
+            good = sscanf(v, "%dx%d", &width, &height) == 2 && width > 0 && height > 0
+                && (long long)width * height <= 2073600; // Bitmap's limit
+        else if(key == "split")
+            good = sscanf(v, "%d", &depth) == 1 && depth >= 0 && depth <= 6;
+        else if(key == "rotx" || key == "roty" || key == "rotz") {
+            good = sscanf(v, "%lf", &a) == 1;
+            rotations.push_back(make_pair(key[3], a));
+        } else if(key == "move")
+            good = sscanf(v, "%lf,%lf,%lf", &move.x, &move.y, &move.z) == 3;
+        else if(key == "scale")
+            good = sscanf(v, "%lf", &scale) == 1;
+        else if(key == "zoom")
+            good = sscanf(v, "%lf", &camera.zoom) == 1;
+        else if(key == "focus")
+            good = sscanf(v, "%lf", &camera.focus) == 1;
+        else if(key == "height")
+            good = sscanf(v, "%lf", &camera.height) == 1;
+        else if(key == "eye" || key == "target" || key == "up") {
+            P3 &p = key == "eye" ? eye : key == "target" ? target : up;
+            good = sscanf(v, "%lf,%lf,%lf", &p.x, &p.y, &p.z) == 3;
+            view = view || key == "eye";
+        } else if(key == "fov")
+            good = sscanf(v, "%lf", &fov) == 1 && fov > 0 && fov < 180, span = 0;
+        else if(key == "ortho")
+            good = sscanf(v, "%lf", &span) == 1 && span > 0;
+        else if(key == "near")
+            good = sscanf(v, "%lf", &near) == 1 && near > 0;
+        else if(key == "color" || key == "background") {
+            good = sscanf(v, "%d,%d,%d", &R, &G, &B) == 3;
+            (key == "color" ? color : background) = RGB((unsigned char)R, (unsigned char)G, (unsigned char)B);
+        } else if(key == "aa")
+            antialias = value != "0";
+        else if(key == "blur" || key == "pixelate" || key == "unsharp") {
+            good = sscanf(v, "%lf,%lf", &a, &b) >= 1 && a >= 1;
+            PostFilter f = { key, a, key == "unsharp" && value.find(',') == string::npos ? 1.0 : b };
+            filters.push_back(f);
+        } else if(key == "sharpen" || key == "emboss" || key == "sobel" || key == "grayscale") {
+            PostFilter f = { key, 0, 0 };
+            filters.push_back(f);
+        } else {
+            error = "unknown key '" + key + "'";
+            return false;
+        }
+        if(!good) {
+            error = "bad value in '" + word + "'";
+            return false;
+        }
+    }
+    if(model.empty() || out.empty()) {
+        error = "model= and out= are required";
+        return false;
+    }
+    if(view && (eye - target).len2() == 0) {
+        error = "eye= and target= are the same point";
+        return false;
+    }
+    for(int i = 0; i < int(filters.size()); i++)
+        if(filters[i].a > max(width, height)) { // a radius or block past the image only costs time
+            error = filters[i].name + " larger than the image";
+            return false;
+        }
+    return true;
+}
+
+// every job of a file, or the first error
+bool readJobs(const char *name, vector<RenderJob>& jobs, string& error) {
+    ifstream file(name);
+    if(!file) {
+        error = string("cannot open ") + name;
+        return false;
+    }
+    string text;
+    for(int n = 1; getline(file, text); n++) {
+        size_t first = text.find_first_not_of(" \t\r");
+        if(first == string::npos || text[first] == '#')
+            continue;
+        RenderJob job;
+        job.line = n;
+        if(!job.parse(text, error)) {
+            char where[32];
+            sprintf(where, ":%d: ", n);
+            error = name + (where + error);
+            return false;
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+
+/******************************************************************************/
+//  ModelCache Member Functions
+/******************************************************************************/
+
+ModelCache::ModelCache() {
+    maxPatches = 1 << 18;
+    tick = 0;
+}
+
+// empty if the file could not be read
+shared_ptr<const BezObj> ModelCache::get(const string& path, int depth) {
+    pair<string, int> key(path, depth);
+    shared_ptr<Entry> entry;
+    {
+        lock_guard<mutex> guard(lock);
+        shared_ptr<Entry> &slot = entries[key];
+        if(!slot)
+            slot = make_shared<Entry>();
+        slot->used = ++tick;
+        entry = slot;
+    }
+    // the first caller builds it, the others wait here
+    call_once(entry->once, [&] {
+        if(depth == 0)
+            entry->obj.load(path.c_str());
+        else {
+            entry->obj = *get(path, depth - 1);
+            entry->obj.split(1);
+        }
+        lock_guard<mutex> guard(lock);
+        entry->ready = true, entry->used = ++tick;  // newer than the depths it was split from
+        map< pair<string, int>, shared_ptr<Entry> >::iterator it = entries.find(key);
+        if(!entry->obj.data.empty())
+            trim();
+        else if(it != entries.end() && it->second == entry) // a read failure is not kept
+            entries.erase(it);
+    });
+    return shared_ptr<const BezObj>(entry, &entry->obj);
+}
+
+// models and depths held
+size_t ModelCache::size() {
+    lock_guard<mutex> guard(lock);
+    return entries.size();
+}
+
+// drop everything not in use
+void ModelCache::clear() {
+    lock_guard<mutex> guard(lock);
+    entries.clear();
+}
+
+// evict down to maxPatches, least recently asked for first; entries still
+// being built do not count and are not evicted
+void ModelCache::trim() {
+    size_t held = 0;
+    for(map< pair<string, int>, shared_ptr<Entry> >::iterator it = entries.begin(); it != entries.end(); ++it)
+        if(it->second->ready)
+            held += it->second->obj.data.size();
+    while(held > maxPatches) {
+        map< pair<string, int>, shared_ptr<Entry> >::iterator oldest = entries.end();
+        for(map< pair<string, int>, shared_ptr<Entry> >::iterator it = entries.begin(); it != entries.end(); ++it)
+            if(it->second->ready && (oldest == entries.end() || it->second->used < oldest->second->used))
+                oldest = it;
+        if(oldest == entries.end())
+            break;
+        held -= oldest->second->obj.data.size();
+        entries.erase(oldest);
+    }
+}
+
+
+/******************************************************************************/
+//  BatchRenderer Member Functions
+/******************************************************************************/
+
+BatchRenderer::BatchRenderer(int threads = 0) {
+    this->threads = threads > 0 ? threads : max(int(thread::hardware_concurrency()), 1);
+    deterministic = false;
+}
+
+int BatchRenderer::getThreads() {
+    return threads;
+}
+
+void BatchRenderer::run(vector<RenderJob>& jobs) {
+    TaskGraph graph(threads, 8 * threads, deterministic);
+    for(int i = 0; i < int(jobs.size()); i++) {
+        RenderJob *job = &jobs[i];
+        Work *work = new Work;
+        int a = graph.add([this, job, work] { model(*job, *work); });
+        int b = graph.add([this, job, work] { shot(*job, *work); }, a);
+        int c = graph.add([this, job, work] { filter(*job, *work); }, b);
+        graph.add([this, job, work] { save(*job, *work); delete work; }, c);
+    }
+    graph.wait();
+}
+
+// one job, every stage on the calling thread
+void BatchRenderer::render(RenderJob& job) {
+    Work work;
+    model(job, work);
+    shot(job, work);
+    filter(job, work);
+    save(job, work);
+}
+
+void BatchRenderer::model(RenderJob& job, Work& work) {
+    work.start = clock::now();
+    job.ok = false, job.error.clear();
+    job.loadMs = job.renderMs = job.filterMs = job.saveMs = 0;
+    // a ViewCamera places the shared model itself: nothing to copy
+    if(job.view) {
+        work.cached = models.get(job.model, job.depth);
+        work.model = work.cached.get();
+        if(work.model->data.empty())
+            job.error = "cannot read " + job.model;
+        job.loadMs = chrono::duration<double, milli>(clock::now() - work.start).count();
+        return;
+    }
+    work.obj = *models.get(job.model, job.depth);
+    work.model = &work.obj;
+    if(work.obj.data.empty())
+        job.error = "cannot read " + job.model;
+    work.obj.scale = job.scale;
+    for(int i = 0; i < int(job.rotations.size()); i++)
+        switch(job.rotations[i].first) {
+            case 'x': work.obj.rotateX(job.rotations[i].second); break;
+            case 'y': work.obj.rotateY(job.rotations[i].second); break;
+            default: work.obj.rotateZ(job.rotations[i].second); break;
+        }
+    work.obj.move(job.move);
+    job.loadMs = chrono::duration<double, milli>(clock::now() - work.start).count();
+}
+
+void BatchRenderer::shot(RenderJob& job, Work& work) {
+    if(!job.error.empty())
+        return;
+    clock::time_point start = clock::now();
+    if(!work.bmp.setSize(job.width, job.height)) {
+        job.error = "canvas too large";
+        return;
+    }
+    work.bmp.set(job.background);
+    work.bmp.setColor(job.color);
+    work.bmp.setAntialias(job.antialias);
+    if(job.view) {
+        // rotations in the order written, then scale and move, as on a copy
+        Matrix4 place = Matrix4::identity();
+        for(int i = 0; i < int(job.rotations.size()); i++) {
+            double a = job.rotations[i].second;
+            char axis = job.rotations[i].first;
+            place = (axis == 'x' ? Matrix4::rotateX(a) : axis == 'y' ? Matrix4::rotateY(a) : Matrix4::rotateZ(a)) * place;
+        }
+        place = Matrix4::translate(job.move) * Matrix4::scale(job.scale) * place;
+        ViewCamera cam;
+        if(!cam.lookAt(job.eye, job.target, job.up)) {
+            job.error = "eye and target are the same point";
+            return;
+        }
+        if(job.span > 0)
+            cam.orthographic(job.span, job.near);
+        else
+            cam.perspective(job.fov, job.near);
+        cam.shot(*work.model, place, work.bmp);
+    } else
+        job.camera.shot(work.obj, work.bmp);
+    work.obj.clear();
+    job.renderMs = chrono::duration<double, milli>(clock::now() - start).count();
+}
+
+void BatchRenderer::filter(RenderJob& job, Work& work) {
+    if(!job.error.empty())
+        return;
+    clock::time_point start = clock::now();
+    ImageProcessor ip(&work.bmp);
+    for(int i = 0; i < int(job.filters.size()); i++) {
+        const PostFilter &f = job.filters[i];
+        if(f.name == "blur")
+            ip.GaussianBlur(int(f.a));
+        else if(f.name == "pixelate")
+            ip.pixelate(int(f.a));
+        else if(f.name == "unsharp")
+            ip.unsharpMask(int(f.a), f.b);
+        else if(f.name == "sharpen")
+            ip.sharpen();
+        else if(f.name == "emboss")
+            ip.emboss();
+        else if(f.name == "sobel")
+            ip.sobel();
+        else
+            ip.grayscale();
+    }
+    job.filterMs = chrono::duration<double, milli>(clock::now() - start).count();
+}
+
+// the total runs from the start of the model stage, waits between stages included
+void BatchRenderer::save(RenderJob& job, Work& work) {
+    if(job.error.empty()) {
+        clock::time_point start = clock::now();
+        job.ok = work.bmp.save(job.out.c_str());
+        if(!job.ok)
+            job.error = "cannot write " + job.out;
+        job.saveMs = chrono::duration<double, milli>(clock::now() - start).count();
+    }
+    work.cached.reset();
+    job.totalMs = chrono::duration<double, milli>(clock::now() - work.start).count();
+}
+
+#endif /* __BATCH_H__ */
@@ -3,9 +3,12 @@
 
 #include <fstream>
 #include <vector>
+#include <algorithm>
 #include <cmath>
 #include "color.h"
 #include "point.h"
+#include "profile.h"
+#include "arena.h"
 
 using namespace std;
 
@@ -29,10 +32,11 @@ struct BitmapHeader {
 };
 #pragma pack()
 
+// rows of 24-bit pixels padded to 4 bytes
 void bitmapHeaderInit(struct BitmapHeader& header, int w, int h) {
 	header.identity[0] = 'B';
 	header.identity[1] = 'M';
-	header.file_size = (w * 3) * h + 54;
+	header.file_size = ((w * 3 + 3) & ~3) * h + 54;
 	header.reserved[0] = 0;
 	header.reserved[1] = 0;
 	header.data_offset = 0x36;
@@ -42,25 +46,51 @@ void bitmapHeaderInit(struct BitmapHeader& header, int w, int h) {
 	header.planes = 1;
 	header.bits_per_pixel = 24;
 	header.compression = 0;
-	header.data_size = (w * 3) * h;
+	header.data_size = ((w * 3 + 3) & ~3) * h;
 	header.hresolution = 0;
 	header.vresolution = 0;
 	header.used_colors = 0;
 	header.important_colors = 0;
 }
 
+enum FillRule { EVEN_ODD, NONZERO };
 
+// run of pixels on one row, [begin, end), x is the buffer column of begin
+struct Span {
+	RGB *begin, *end;
+	int x;
+	int size() { return end - begin; }
+};
+
+
+/*
+Bitmap
+
+owns its buffer and can only be moved, never copied implicitly: use
+clone() for a deep copy. Rows are `stride` pixels apart, which is the
+width for a Bitmap of its own and the parent's stride for a BitmapView.
+Nothing is written on destruction; call save() (to the name given at
+construction) or save(name).
+*/
 class Bitmap {
 public:
 	Bitmap();
 	Bitmap(int width, int height);
 	Bitmap(const char* name);
 	Bitmap(const char* name, int width, int height);
-	~Bitmap();
+	Bitmap(Bitmap&& other);
+	Bitmap& operator=(Bitmap&& other);
+	Bitmap(const Bitmap&) = delete;
+	Bitmap& operator=(const Bitmap&) = delete;
+	virtual ~Bitmap();
+	Bitmap clone();						// deep copy with its own tight buffer
 	void line(P2, P2, RGB);
 	void line(P2 p1, P2 p2);
 	void line(P2P pp);
 	void line(P2P pp, RGB c);
+	template<class T> void line(Point2<T> p1, Point2<T> p2);		// in the precision of the points
+	template<class T> void line(Point2<T> p1, Point2<T> p2, RGB c);
+	void aaLine(P2, P2, RGB);
 	void triangle(P2, P2, P2);
 	void triangle(P2T pt);
 	void sTriangle(P2, P2, P2);
@@ -68,11 +98,16 @@ public:
 	void sTriangle(P2T pt, RGB rgb);
 	void p4(P2, P2, P2, P2);
 	void ball(P2, double);
+	void balls(const vector<P2>&, double);
 	void circle(P2, double);
 	void square(P2, P2);
 	void sSquare(P2, P2);
 	void frame(const vector<P2>&);
 	void connect(const vector<P2>&);
+	void connect(const P2* pv, int n);
+	void sPolygon(const vector<P2>&, FillRule rule);
+	void sPolygon(const P2* pv, int n, FillRule rule, Arena& arena);	// edge lists in the arena
+	void floodFill(P2 seed, int tolerance, bool eight);
 	void set(P2 point);
 	void set(P2 point, const RGB color);
 	void set(const vector<P2>&);
@@ -84,55 +119,176 @@ public:
 	void setColor(unsigned char R, unsigned char G, unsigned char B);
 	void setOrigin(P2 point);
 	void setOriginCenter();
+	void setAntialias(bool on);
+	void setMSAA(int samples);
 	RGB get(P2 point);
 	int getWidth();
 	int getHeight();
 	P2 getOrigin();
-	void save(const char* name);
+	int getStride();					// pixels from one row to the next
+	bool isView();						// buffer belongs to another bitmap
+	bool save();						// to the name given at construction
+	bool save(const char* name);		// false if the file could not be written
 	bool load(const char*);
 	void setBuffer(RGB *buffer);
-private:
-	int width, height;
+	RGB *getBuffer();
+	// raw access, buffer coordinates (no origin), unchecked unless noted
+	RGB *row(int y) { return buffer + y * stride; }
+	Span span(int y, int x0, int x1);	// x0..x1 inclusive, clipped to the canvas
+	void setRaw(int x, int y) { buffer[y * stride + x] = color; }
+	void setRaw(int x, int y, RGB c) { buffer[y * stride + x] = c; }
+protected:
+	int width, height, stride;
 	const char* name;
 	struct BitmapHeader header;
 	RGB *buffer = NULL;
+	bool owner;							// buffer is ours to delete
 	P2 origin;
 	RGB color;
-	static const double PI = 3.1416;
+	bool antialias;
+	int msaa;						// samples per pixel for filled triangles, 1 = off
+	vector<int> sampleIndex;		// per buffer pixel: its entry in samples, -1 if none; empty until the first edge pixel
+	vector<RGB> samples;			// per edge pixel: last resolved color, then msaa samples
+	void cover(int i, unsigned mask, RGB c);
+	struct Edge {					// polygon edge for sPolygon
+		int y0, y1;					// rows covered, y1 exclusive
+		double x, dx;				// crossing at the current row, step per row
+		int dir;					// +1 downward, -1 upward
+		static bool first(const Edge& a, const Edge& b) { return a.y0 < b.y0; }
+	};
+	void blend(int x, int y, RGB c, double coverage);
+	static bool near(RGB a, RGB b, int tolerance) {
+		return abs(a.R - b.R) <= tolerance && abs(a.G - b.G) <= tolerance && abs(a.B - b.B) <= tolerance;
+	}
+	static int clampPixel(double v, int lo, int hi) {	// v within [lo, hi] as an int, NaN as lo; converts any double safely
+		return v > lo ? (v < hi ? int(v) : hi) : lo;
+	}
+	void init();
+	static const double PI;
 	double deg2rad(double deg) { return (deg * 3.1416) / 180; }
 	double rad2deg(double rad) { return (rad * 180) / 3.1416; }
 };
 
+const double Bitmap::PI = 3.1416;
+
+/*
+BitmapView
+
+non-owning window onto a rectangle of another bitmap's buffer, with its
+own size and origin (centered like any Bitmap) and the parent's stride.
+Drawing, ImageProcessor and Pipeline work on it in place; it must not
+outlive the parent's buffer, and it cannot be resized.
+*/
+class BitmapView : public Bitmap {
+public:
+	BitmapView(Bitmap& parent, int x, int y, int width, int height);	// buffer coordinates, clipped to the parent
+};
+
+/*
+OriginView
+
+integer pixel access in the bitmap's own coordinates (origin applied)
+for tight loops: the origin, size and buffer are read once when the
+view is made, so keep it for the duration of one drawing pass and make
+a new one after setOrigin or setSize
+*/
+class OriginView {
+public:
+	OriginView(Bitmap& bmp);
+	bool inside(int x, int y) { x += ox, y += oy; return x >= 0 && y >= 0 && x < width && y < height; }
+	RGB *row(int y) { return buffer + (y + oy) * stride + ox; }	// row[x] is point (x, y)
+	void set(int x, int y, RGB c) { if(inside(x, y)) buffer[(y + oy) * stride + x + ox] = c; }
+	void setRaw(int x, int y, RGB c) { buffer[(y + oy) * stride + x + ox] = c; }	// unchecked
+	RGB get(int x, int y) { return inside(x, y) ? buffer[(y + oy) * stride + x + ox] : RGB(); }
+	Span span(int y, int x0, int x1);	// x0..x1 inclusive, clipped to the canvas
+private:
+	RGB *buffer;
+	int width, height, stride, ox, oy;
+	Bitmap *bmp;
+};
+
 
 // Constructors
 
 Bitmap::Bitmap() {
-	this->name = "";
-	setColor(RGB(255, 255, 255));
+	init();
 }
 
 Bitmap::Bitmap(int width, int height) {
-	this->name = NULL;
+	init();
 	setSize(width, height);
 	set(RGB(0, 0, 0));
-	setColor(RGB(255, 255, 255));
 }
 
 Bitmap::Bitmap(const char* name) {
+	init();
+	setName(name);
 	load(name);
 }
 
 Bitmap::Bitmap(const char* name, int width, int height) {
+	init();
 	setName(name);
 	setSize(width, height);
 	set(RGB(0, 0, 0));
-	setColor(RGB(255, 255, 255));
+}
+
+Bitmap::Bitmap(Bitmap&& other) {
+	init();
+	*this = std::move(other);
+}
+
+Bitmap& Bitmap::operator=(Bitmap&& other) {
+	if(this == &other)
+		return *this;
+	if(owner)
+		delete [] buffer;
+	width = other.width, height = other.height, stride = other.stride;
+	name = other.name, header = other.header;
+	buffer = other.buffer, owner = other.owner;
+	origin = other.origin, color = other.color;
+	antialias = other.antialias, msaa = other.msaa;
+	sampleIndex.swap(other.sampleIndex), samples.swap(other.samples);
+	other.buffer = NULL, other.owner = true;
+	other.width = other.height = other.stride = 0;
+	return *this;
 }
 
 Bitmap::~Bitmap() {
-	if(this->name)
-		save(this->name);
-	delete [] buffer;
+	if(owner)
+		delete [] buffer;
+}
+
+// empty, white pen
+void Bitmap::init() {
+	width = height = stride = 0;
+	name = NULL;
+	buffer = NULL, owner = true;
+	origin = P2(0, 0);
+	antialias = false;
+	msaa = 1;
+	setColor(RGB(255, 255, 255));
+}
+
+// deep copy with its own tight buffer
+Bitmap Bitmap::clone() {
+	Bitmap copy(width, height);
+	for(int y = 0; y < height; y++)
+		copy_n(row(y), width, copy.row(y));
+	copy.name = name, copy.origin = origin, copy.color = color;
+	copy.antialias = antialias, copy.msaa = msaa;
+	return copy;
+}
+
+// buffer coordinates, clipped to the parent
+BitmapView::BitmapView(Bitmap& parent, int x, int y, int width, int height) {
+	int x0 = max(x, 0), y0 = max(y, 0);
+	int x1 = min(x + width, parent.getWidth()), y1 = min(y + height, parent.getHeight());
+	this->width = max(x1 - x0, 0), this->height = max(y1 - y0, 0);
+	stride = parent.getStride();
+	buffer = parent.row(y0) + x0, owner = false;
+	bitmapHeaderInit(header, this->width, this->height);
+	setOriginCenter();
 }
 
 
@@ -141,10 +297,8 @@ Bitmap::~Bitmap() {
 void Bitmap::square(P2 m, P2 p) {
 	P2 v1 = p - m;
 	P2 v2 = P2(v1.y, -v1.x);
-	vector<P2> vtx;
-	vtx.push_back(m + v1); vtx.push_back(m + v2);
-	vtx.push_back(m - v1); vtx.push_back(m - v2);
-	connect(vtx);
+	P2 vtx[4] = { m + v1, m + v2, m - v1, m - v2 };
+	connect(vtx, 4);
 }
 
 void Bitmap::sSquare(P2 m, P2 p) {
@@ -181,16 +335,77 @@ void Bitmap::sTriangle(P2T pt, RGB rgb) {
 	color = temp;
 }
 
+// in the precision of the points, P2f or P2q
+template<class T>
+void Bitmap::line(Point2<T> p1, Point2<T> p2) {
+	line(p1, p2, color);
+}
+
+// the same pixels as the double line up to rounding, without its
+// division and conversions per pixel: the minor coordinate steps by the
+// slope in T from one column (or row) of the major axis to the next.
+// The major range is clipped to the bitmap first, in double, so the loop
+// runs on ints and ends even when T(i) could not hold an endpoint.
+// Anti-aliased lines need the fraction and go through double.
+template<class T>
+void Bitmap::line(Point2<T> p1, Point2<T> p2, RGB c) {
+	if(antialias) {
+		aaLine(P2(p1), P2(p2), c);
+		return;
+	}
+	PROFILE_SCOPE("Bitmap::line narrow");
+	PROFILE_COUNT(LINES, 1);
+	T dx = p2.x - p1.x, dy = p2.y - p1.y;
+	bool steep = (dy < T(0) ? -dy : dy) > (dx < T(0) ? -dx : dx);
+	T a0 = steep ? p1.y : p1.x, a1 = steep ? p2.y : p2.x;
+	T slope = a1 == a0 ? T(0) : steep ? dx / dy : dy / dx;
+	int ox = int(origin.x), oy = int(origin.y);
+	// major coordinates inside the bitmap, before the origin
+	int lo = steep ? -oy : -ox, hi = (steep ? height : width) - 1 + lo;
+	int step = a1 < a0 ? -1 : 1;
+	double last = step > 0 ? floor(double(a1)) : ceil(double(a1));
+	int i = clampPixel(double(a0), lo - 1, hi + 1), end = clampPixel(last, lo - 1, hi + 1);
+	long long written = 0, clipped = 0;
+	bool cut = step > 0 ? i < lo : i > hi;
+	if(cut)
+		clipped += abs(i - (step > 0 ? lo : hi)), i = step > 0 ? lo : hi;
+	if(step > 0 ? end > hi : end < lo)
+		clipped += abs(end - (step > 0 ? hi : lo)), end = step > 0 ? hi : lo;
+	// minor coordinate at the first pixel, origin included; after a cut
+	// the distance from a0 may not fit in T
+	T b0 = steep ? p1.x + T(ox) : p1.y + T(oy);
+	T b = cut ? T(double(b0) + double(slope) * (i - double(a0))) : b0 + slope * (T(i) - a0);
+	T db = step > 0 ? slope : -slope;
+	for(; step > 0 ? i <= end : i >= end; i += step, b += db) {
+		int x = steep ? clampPixel(double(b), -1, width) : i + ox;
+		int y = steep ? i + oy : clampPixel(double(b), -1, height);
+		if(x >= 0 && y >= 0 && x < width && y < height)
+			buffer[y * stride + x] = c, written++;
+		else
+			clipped++;
+	}
+	PROFILE_COUNT(PIXELS_WRITTEN, written);
+	PROFILE_COUNT(PIXELS_CLIPPED, clipped);
+}
+
 void Bitmap::line(P2 p1, P2 p2, RGB c) {
+	PROFILE_SCOPE("Bitmap::line");
+	PROFILE_COUNT(LINES, 1);
+	if(antialias) {
+		aaLine(p1, p2, c);
+		return;
+	}
 	double dx = p2.x - p1.x, dy = p2.y - p1.y;
 	if(dx == 0 || dy == 0) {
 		if(dx != 0) {
-			if(dx > 0)
-				for(int i=p1.x; i<=p2.x; i++)
-					set(P2(double(i), p1.y), c);
-			else if(dx < 0)
-				for(int i=p1.x; i>=p2.x; i--)
-					set(P2(double(i), p1.y), c);
+			// one span, the same pixels a loop over set() would write
+			int a = int(p1.x), b = int(dx > 0 ? floor(p2.x) : ceil(p2.x));
+			if(dx > 0 ? a <= b : a >= b) {
+				Span s = span(int(p1.y + origin.y), int(a + origin.x), int(b + origin.x));
+				fill(s.begin, s.end, c);
+				PROFILE_COUNT(PIXELS_WRITTEN, s.size());
+				PROFILE_COUNT(PIXELS_CLIPPED, abs(b - a) + 1 - s.size());
+			}
 		} else if(dy != 0) {
 			if(dy > 0)
 				for(int j=p1.y; j<=p2.y; j++)
@@ -219,24 +434,156 @@ void Bitmap::line(P2 p1, P2 p2, RGB c) {
 	}
 }
 
+// Xiaolin Wu's line: two pixels per step weighted by distance to the line
+void Bitmap::aaLine(P2 p1, P2 p2, RGB c) {
+	// buffer coordinates with pixel centers on integers
+	double x0 = p1.x + origin.x - 0.5, y0 = p1.y + origin.y - 0.5;
+	double x1 = p2.x + origin.x - 0.5, y1 = p2.y + origin.y - 0.5;
+	bool steep = fabs(y1 - y0) > fabs(x1 - x0);
+	if(steep)
+		swap(x0, y0), swap(x1, y1);
+	if(x0 > x1)
+		swap(x0, x1), swap(y0, y1);
+	double dx = x1 - x0, dy = y1 - y0;
+	double gradient = dx == 0 ? 1.0 : dy / dx;
+	// end points cover part of their pixel
+	int xs = int(floor(x0 + 0.5)), xe = int(floor(x1 + 0.5));
+	double ys = y0 + gradient * (xs - x0), ye = y1 + gradient * (xe - x1);
+	double gs = 1 - (x0 + 0.5 - floor(x0 + 0.5)), ge = x1 + 0.5 - floor(x1 + 0.5);
+	if(xs == xe)
+		gs = ge = x1 - x0;
+	int iy = int(floor(ys));
+	double f = ys - iy;
+	if(steep)
+		blend(iy, xs, c, (1 - f) * gs), blend(iy + 1, xs, c, f * gs);
+	else
+		blend(xs, iy, c, (1 - f) * gs), blend(xs, iy + 1, c, f * gs);
+	if(xe != xs) {
+		iy = int(floor(ye)), f = ye - iy;
+		if(steep)
+			blend(iy, xe, c, (1 - f) * ge), blend(iy + 1, xe, c, f * ge);
+		else
+			blend(xe, iy, c, (1 - f) * ge), blend(xe, iy + 1, c, f * ge);
+	}
+	// interior, clipped to the canvas along the major axis
+	int lo = xs + 1, hi = xe - 1;
+	int limit = steep ? height - 1 : width - 1;
+	double y = ys + gradient;
+	if(lo < 0)
+		y += gradient * -lo, lo = 0;
+	if(hi > limit)
+		hi = limit;
+	for(int x = lo; x <= hi; x++, y += gradient) {
+		int yi = int(floor(y));
+		double fr = y - yi;
+		if(steep)
+			blend(yi, x, c, 1 - fr), blend(yi + 1, x, c, fr);
+		else
+			blend(x, yi, c, 1 - fr), blend(x, yi + 1, c, fr);
+	}
+}
+
 void Bitmap::triangle(P2 p1, P2 p2, P2 p3) {
+	PROFILE_COUNT(TRIANGLES, 1);
 	line(p1, p2);
 	line(p1, p3);
 	line(p2, p3);
 }
 
+// filled triangle, edges inclusive
+// with MSAA only pixels crossed by an edge test every sample; the
+// rest are filled (or skipped) after one test at the pixel center
 void Bitmap::sTriangle(P2 p1, P2 p2, P2 p3) {
-	double area2o = fabs(det(p3 - p1, p2 - p1));
-	for(int i = 0 - int(origin.x); i < width - int(origin.x); i++) {
-		for(int j = 0 - int(origin.y); j < height - int(origin.y); j++) {
-			double area2n = 0.0;
-			area2n += fabs(det(P2(i, j) - p1, P2(i, j) - p2));
-			area2n += fabs(det(P2(i, j) - p2, P2(i, j) - p3));
-			area2n += fabs(det(P2(i, j) - p3, P2(i, j) - p1));
-			if(area2n <= area2o)
-				set(P2(i, j));
+	// sample positions, 1/16 pixel units around the center
+	static const int grid4[4][2] = { {-2, -6}, {6, -2}, {-6, 2}, {2, 6} };
+	static const int grid8[8][2] = { {1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7} };
+	PROFILE_SCOPE("Bitmap::sTriangle");
+	PROFILE_COUNT(TRIANGLES, 1);
+	const int (*grid)[2] = msaa == 8 ? grid8 : grid4;
+	double area = det(p2 - p1, p3 - p1);
+	if(area == 0)
+		return;
+	if(area < 0)
+		swap(p2, p3);
+	P2 v[3] = { p1, p2, p3 };
+	// edge k: E(x, y) = a * x + b * y + c >= 0 inside
+	double a[3], b[3], c[3], reach[3];
+	for(int k = 0; k < 3; k++) {
+		P2 p = v[k], q = v[(k + 1) % 3];
+		a[k] = -(q.y - p.y), b[k] = q.x - p.x;
+		c[k] = -(a[k] * p.x + b[k] * p.y);
+		reach[k] = (fabs(a[k]) + fabs(b[k])) * 0.5; // largest change within the pixel
+	}
+	int ox = int(origin.x), oy = int(origin.y);
+	double pad = msaa > 1 ? 0.5 : 0.0;
+	// clamped to one pixel past the bitmap before converting, so any coordinate is safe
+	int x0 = clampPixel(ceil(min(p1.x, min(p2.x, p3.x)) - pad) + ox, -1, width), x1 = clampPixel(floor(max(p1.x, max(p2.x, p3.x)) + pad) + ox, -1, width);
+	int y0 = clampPixel(ceil(min(p1.y, min(p2.y, p3.y)) - pad) + oy, -1, height), y1 = clampPixel(floor(max(p1.y, max(p2.y, p3.y)) + pad) + oy, -1, height);
+	bool clipped = x0 < 0 || y0 < 0 || x1 >= width || y1 >= height;
+	x0 = max(x0, 0), y0 = max(y0, 0), x1 = min(x1, width - 1), y1 = min(y1, height - 1);
+	long long written = 0;
+	for(int y = y0; y <= y1; y++) {
+		double py = y - oy;
+		for(int x = x0; x <= x1; x++) {
+			double px = x - ox;
+			bool in = true, out = false;
+			for(int k = 0; k < 3; k++) {
+				double e = a[k] * px + b[k] * py + c[k];
+				if(msaa > 1 ? e < reach[k] : e < 0)
+					in = false;
+				if(e < -reach[k])
+					out = true;
+			}
+			if(in) {
+				buffer[y * stride + x] = color;
+				if(!sampleIndex.empty() && sampleIndex[y * stride + x] >= 0)
+					cover(y * stride + x, (1u << msaa) - 1, color);
+				written++;
+				continue;
+			}
+			if(msaa <= 1 || out)
+				continue;
+			unsigned mask = 0;
+			for(int s = 0; s < msaa; s++) {
+				double sx = px + grid[s][0] / 16.0, sy = py + grid[s][1] / 16.0;
+				if(a[0] * sx + b[0] * sy + c[0] >= 0 && a[1] * sx + b[1] * sy + c[1] >= 0 && a[2] * sx + b[2] * sy + c[2] >= 0)
+					mask |= 1u << s;
+			}
+			if(mask)
+				cover(y * stride + x, mask, color), written++;
+		}
+	}
+	PROFILE_COUNT(PIXELS_WRITTEN, written);
+	PROFILE_COUNT(PIXELS_CLIPPED, clipped ? max(0LL, (long long)(fabs(area) / 2) - written) : 0);
+}
+
+// write c to the samples in mask of buffer pixel i and resolve it
+// a pixel gets at most one entry, so samples never outgrows the buffer
+void Bitmap::cover(int i, unsigned mask, RGB c) {
+	int n = msaa + 1, at = sampleIndex.empty() ? -1 : sampleIndex[i];
+	if(at < 0) {
+		if(mask == (1u << msaa) - 1) {
+			buffer[i] = c; // fully covered, nothing to remember
+			return;
 		}
+		if(sampleIndex.empty())
+			sampleIndex.assign(stride * height, -1);
+		at = samples.size();
+		samples.resize(at + n);
+		sampleIndex[i] = at;
+		samples[at] = RGB(~buffer[i].R, buffer[i].G, buffer[i].B); // force a refill below
+	}
+	RGB &last = samples[at];
+	if(last.R != buffer[i].R || last.G != buffer[i].G || last.B != buffer[i].B)
+		for(int s = 1; s < n; s++) // drawn over since, start from what is there now
+			samples[at + s] = buffer[i];
+	int R = 0, G = 0, B = 0;
+	for(int s = 0; s < msaa; s++) {
+		if(mask & (1u << s))
+			samples[at + 1 + s] = c;
+		R += samples[at + 1 + s].R, G += samples[at + 1 + s].G, B += samples[at + 1 + s].B;
 	}
+	buffer[i] = last = RGB((unsigned char)(R / msaa), (unsigned char)(G / msaa), (unsigned char)(B / msaa));
 }
 
 void Bitmap::p4(P2 p1, P2 p2, P2 p3, P2 p4) {
@@ -252,32 +599,229 @@ void Bitmap::frame(const vector<P2>& pv) {
 }
 
 void Bitmap::connect(const vector<P2>& pv) {
-	for(int i = 1; i < pv.size(); i++)
+	connect(pv.data(), pv.size());
+}
+
+void Bitmap::connect(const P2* pv, int n) {
+	if(n <= 0)
+		return;
+	for(int i = 1; i < n; i++)
 		line(pv[i - 1], pv[i]);
-	line(pv[0], pv[pv.size() - 1]);
-	//for(int i = 0; i < pv.size(); i++) ball(pv[i], 3.0);
+	line(pv[0], pv[n - 1]);
+	//for(int i = 0; i < n; i++) ball(pv[i], 3.0);
+}
+
+// filled polygon, any shape, pixel centers on the left edge of a span count
+// edges are sorted by their first row and kept in an active list ordered
+// by x, so each row costs its crossings plus one fill per span
+void Bitmap::sPolygon(const vector<P2>& pv, FillRule rule = EVEN_ODD) {
+	Arena scratch(2 * pv.size() * sizeof(Edge) + 64);
+	sPolygon(pv.data(), pv.size(), rule, scratch);
+}
+
+// edge lists in the arena, reserved up front: nothing else is allocated
+void Bitmap::sPolygon(const P2* pv, int n, FillRule rule, Arena& arena) {
+	PROFILE_SCOPE("Bitmap::sPolygon");
+	int ox = int(origin.x), oy = int(origin.y);
+	long long written = 0;
+	ArenaVector<Edge> edges(arena);
+	edges.reserve(n);
+	for(int i = 0; i < n; i++) {
+		P2 a = pv[i], b = pv[(i + 1) % n];
+		int dir = 1;
+		if(a.y > b.y)
+			swap(a, b), dir = -1;
+		// rows whose center y satisfies a.y <= y < b.y, clamped before converting
+		Edge e;
+		e.y0 = clampPixel(ceil(a.y) + oy, 0, height);
+		e.y1 = clampPixel(ceil(b.y) + oy, 0, height);
+		if(e.y0 >= e.y1)
+			continue;
+		e.dx = (b.x - a.x) / (b.y - a.y);
+		e.x = a.x + (e.y0 - oy - a.y) * e.dx + ox;
+		e.dir = dir;
+		edges.push_back(e);
+	}
+	sort(edges.begin(), edges.end(), Edge::first);
+	ArenaVector<Edge> active(arena);
+	active.reserve(edges.size());
+	int next = 0;
+	for(int y = edges.empty() ? height : edges[0].y0; y < height; y++) {
+		for(int i = 0; i < int(active.size()); )
+			if(active[i].y1 <= y)
+				active.erase(active.begin() + i);
+			else
+				i++;
+		while(next < int(edges.size()) && edges[next].y0 == y)
+			active.push_back(edges[next++]);
+		if(active.empty()) {
+			if(next == int(edges.size()))
+				break;
+			y = edges[next].y0 - 1;
+			continue;
+		}
+		// nearly sorted from the last row
+		for(int i = 1; i < int(active.size()); i++)
+			for(int j = i; j > 0 && active[j].x < active[j - 1].x; j--)
+				swap(active[j], active[j - 1]);
+		RGB *row = buffer + y * stride;
+		int winding = 0;
+		for(int i = 0; i + 1 < int(active.size()); i++) {
+			winding += rule == NONZERO ? active[i].dir : 1;
+			bool inside = rule == NONZERO ? winding != 0 : (winding & 1);
+			if(!inside)
+				continue;
+			int x0 = clampPixel(ceil(active[i].x), 0, width);
+			int x1 = clampPixel(ceil(active[i + 1].x), 0, width);
+			if(x0 < x1)
+				fill(row + x0, row + x1, color), written += x1 - x0;
+		}
+		for(int i = 0; i < int(active.size()); i++)
+			active[i].x += active[i].dx;
+	}
+	PROFILE_COUNT(PIXELS_WRITTEN, written);
+}
+
+// fill the region connected to seed whose pixels are within tolerance
+// (per channel) of the seed pixel
+// runs are filled whole; a stack of seeds holds one entry per run found
+// on the rows above and below, and a bit per pixel marks what is done
+void Bitmap::floodFill(P2 seed, int tolerance = 0, bool eight = false) {
+	PROFILE_SCOPE("Bitmap::floodFill");
+	P2 s = origin + seed;
+	int sx = int(s.x), sy = int(s.y);
+	if(sx < 0 || sy < 0 || sx >= width || sy >= height)
+		return;
+	RGB target = buffer[sy * stride + sx];
+	vector<unsigned char> done((width * height + 7) / 8, 0);
+	vector<int> stack;
+	stack.push_back(sy * width + sx);
+	int e = eight ? 1 : 0;
+	while(!stack.empty()) {
+		int i = stack.back(), y = i / width, x = i % width;
+		stack.pop_back();
+		if(done[i >> 3] & (1 << (i & 7)))
+			continue;
+		RGB *row = buffer + y * stride;
+		int l = x, r = x, base = y * width;
+		while(l > 0 && !(done[(base + l - 1) >> 3] & (1 << ((base + l - 1) & 7))) && near(row[l - 1], target, tolerance))
+			l--;
+		while(r + 1 < width && !(done[(base + r + 1) >> 3] & (1 << ((base + r + 1) & 7))) && near(row[r + 1], target, tolerance))
+			r++;
+		for(int k = base + l; k <= base + r; k++)
+			done[k >> 3] |= 1 << (k & 7);
+		fill(row + l, row + r + 1, color);
+		PROFILE_COUNT(PIXELS_WRITTEN, r - l + 1);
+		// one seed per run of matching pixels next to [l, r]
+		for(int ny = y - 1; ny <= y + 1; ny += 2) {
+			if(ny < 0 || ny >= height)
+				continue;
+			RGB *nrow = buffer + ny * stride;
+			bool run = false;
+			for(int nx = max(l - e, 0); nx <= min(r + e, width - 1); nx++) {
+				int k = ny * width + nx;
+				bool ok = !(done[k >> 3] & (1 << (k & 7))) && near(nrow[nx], target, tolerance);
+				if(ok && !run)
+					stack.push_back(k);
+				run = ok;
+			}
+		}
+	}
 }
 
+// midpoint circle of radius round(r) around the nearest pixel
+// centers and radii past 2^30 pixels are not drawn; they cannot be converted
 void Bitmap::circle(P2 p, double r) {
-	P2 last = p + P2(r, 0.0);
-	for(int n = 0; n <= 720; n++) {
-		P2 now = P2(
-			cos(deg2rad(double(n)/2.0)) * r + p.x,
-			sin(deg2rad(double(n)/2.0)) * r + p.y
-		);
-		line(last, now);
-		last = now;
+	if(!(fabs(p.x) < (1 << 30) && fabs(p.y) < (1 << 30) && r < (1 << 30)))
+		return;
+	int cx = int(floor(p.x + 0.5)) + int(origin.x), cy = int(floor(p.y + 0.5)) + int(origin.y);
+	int R = int(r + 0.5);
+	PROFILE_SCOPE("Bitmap::circle");
+	if(cx + R < 0 || cy + R < 0 || cx - R >= width || cy - R >= height)
+		return;
+	long long written = 0, clipped = 0;
+	int x = R, y = 0, d = 1 - R;
+	while(y <= x) {
+		int px[8] = { x, y, -y, -x, -x, -y, y, x };
+		int py[8] = { y, x, x, y, -y, -x, -x, -y };
+		for(int k = 0; k < 8; k++) {
+			int bx = cx + px[k], by = cy + py[k];
+			if(bx >= 0 && by >= 0 && bx < width && by < height)
+				buffer[by * stride + bx] = color, written++;
+			else
+				clipped++;
+		}
+		y++;
+		if(d < 0)
+			d += 2 * y + 1;
+		else
+			x--, d += 2 * (y - x) + 1;
 	}
+	PROFILE_COUNT(PIXELS_WRITTEN, written);
+	PROFILE_COUNT(PIXELS_CLIPPED, clipped);
 }
 
+// every pixel within r of p, one span per row of the bounding box
 void Bitmap::ball(P2 p, double r) {
-	for(int i = 0 - int(origin.x); i < width - int(origin.x); i++) {
-		for(int j = 0 - int(origin.y); j < height - int(origin.y); j++) {
-			P2 d = P2(i, j) - p;
-			if(d.x * d.x + d.y * d.y <= r * r)
-				set(P2(i, j));
+	PROFILE_SCOPE("Bitmap::ball");
+	if(r < 0)
+		return;
+	double cx = p.x + int(origin.x), cy = p.y + int(origin.y);
+	int y0 = clampPixel(ceil(cy - r), 0, height), y1 = clampPixel(floor(cy + r), -1, height - 1);
+	if(cx + r < 0 || cx - r >= width)
+		return;
+	bool clipped = cx - r < 0 || cy - r < 0 || cx + r > width - 1 || cy + r > height - 1;
+	long long written = 0;
+	for(int y = y0; y <= y1; y++) {
+		double dy = y - cy, h = sqrt(max(r * r - dy * dy, 0.0));
+		int x0 = clampPixel(ceil(cx - h), 0, width), x1 = clampPixel(floor(cx + h), -1, width - 1);
+		if(x0 <= x1)
+			fill(buffer + y * stride + x0, buffer + y * stride + x1 + 1, color), written += x1 - x0 + 1;
+	}
+	PROFILE_COUNT(PIXELS_WRITTEN, written);
+	PROFILE_COUNT(PIXELS_CLIPPED, clipped ? max(0LL, (long long)(PI * r * r) - written) : 0);
+}
+
+// many balls of one radius: the spans are worked out once and
+// reused by every center on whole pixels
+void Bitmap::balls(const vector<P2>& pv, double r) {
+	PROFILE_SCOPE("Bitmap::balls");
+	if(r < 0)
+		return;
+	if(r >= width + height) { // larger than the bitmap: no table, each ball on its own
+		for(int i = 0; i < int(pv.size()); i++)
+			ball(pv[i], r);
+		return;
+	}
+	int R = int(floor(r));
+	vector<int> half(R + 1);
+	long long full = 0, written = 0, clipped = 0;		// full: pixels of one unclipped ball
+	for(int dy = 0; dy <= R; dy++)
+		half[dy] = int(floor(sqrt(r * r - dy * dy))), full += (dy ? 2 : 1) * (2 * half[dy] + 1);
+	int ox = int(origin.x), oy = int(origin.y);
+	for(int i = 0; i < int(pv.size()); i++) {
+		P2 p = pv[i];
+		if(p.x != floor(p.x) || p.y != floor(p.y) || fabs(p.x) >= (1 << 30) || fabs(p.y) >= (1 << 30)) {
+			ball(p, r);
+			continue;
 		}
+		int cx = int(p.x) + ox, cy = int(p.y) + oy;
+		if(cx + R < 0 || cy + R < 0 || cx - R >= width || cy - R >= height) {
+			clipped += full;
+			continue;
+		}
+		int y0 = max(cy - R, 0), y1 = min(cy + R, height - 1);
+		long long before = written;
+		for(int y = y0; y <= y1; y++) {
+			int h = half[abs(y - cy)];
+			int x0 = max(cx - h, 0), x1 = min(cx + h, width - 1);
+			if(x0 <= x1)
+				fill(buffer + y * stride + x0, buffer + y * stride + x1 + 1, color), written += x1 - x0 + 1;
+		}
+		clipped += full - (written - before);
 	}
+	PROFILE_COUNT(PIXELS_WRITTEN, written);
+	PROFILE_COUNT(PIXELS_CLIPPED, clipped);
 }
 
 
@@ -289,15 +833,17 @@ void Bitmap::set(P2 point) {
 }
 
 void Bitmap::set(const RGB color) {
-	for(int i = 0; i < width * height; i++)
-		buffer[i] = color;
+	for(int y = 0; y < height; y++)
+		fill(row(y), row(y) + width, color);
+	sampleIndex.clear();
+	samples.clear();
 }
 
 RGB Bitmap::get(P2 point) {
 	P2 temp = point + origin;
 	int x = int(temp.x), y = int(temp.y);
 	if(x >= 0 && y >= 0 && x < width && y < height)
-		return buffer[y * width + x];
+		return buffer[y * stride + x];
 	else
 		return RGB(0, 0, 0);
 }
@@ -305,8 +851,27 @@ RGB Bitmap::get(P2 point) {
 void Bitmap::set(P2 point, const RGB color) {
 	P2 temp = origin + point;
 	int x = int(temp.x), y = int(temp.y);
-	if(x < width && x >= 0 && y < height && y >= 0)
-		buffer[y * width + x] = color;
+	if(x < width && x >= 0 && y < height && y >= 0) {
+		buffer[y * stride + x] = color;
+		PROFILE_COUNT(PIXELS_WRITTEN, 1);
+	} else
+		PROFILE_COUNT(PIXELS_CLIPPED, 1);
+}
+
+// mix c into buffer pixel (x, y)
+void Bitmap::blend(int x, int y, RGB c, double coverage) {
+	if(coverage <= 0)
+		return;
+	if(x < 0 || y < 0 || x >= width || y >= height) {
+		PROFILE_COUNT(PIXELS_CLIPPED, 1);
+		return;
+	}
+	PROFILE_COUNT(PIXELS_WRITTEN, 1);
+	int a = coverage >= 1 ? 256 : int(coverage * 256);
+	RGB &p = buffer[y * stride + x];
+	p.R = (unsigned char)(p.R + (((int(c.R) - p.R) * a) >> 8));
+	p.G = (unsigned char)(p.G + (((int(c.G) - p.G) * a) >> 8));
+	p.B = (unsigned char)(p.B + (((int(c.B) - p.B) * a) >> 8));
 }
 
 void Bitmap::set(const vector<P2>& v, const RGB color) {
@@ -333,6 +898,18 @@ void Bitmap::setOriginCenter() {
 	origin = P2(width / 2 - 1, height / 2 - 1);
 }
 
+// draw lines anti-aliased
+void Bitmap::setAntialias(bool on) {
+	antialias = on;
+}
+
+// samples per pixel for filled triangles: 1 (off), 4 or 8
+void Bitmap::setMSAA(int samples) {
+	msaa = samples == 4 || samples == 8 ? samples : 1;
+	sampleIndex.clear();
+	this->samples.clear();
+}
+
 int Bitmap::getWidth() {
 	return width;
 }
@@ -345,20 +922,68 @@ P2 Bitmap::getOrigin() {
 	return origin;
 }
 
+// pixels from one row to the next
+int Bitmap::getStride() {
+	return stride;
+}
+
+// buffer belongs to another bitmap
+bool Bitmap::isView() {
+	return !owner;
+}
+
+// copy width * height packed pixels in
 void Bitmap::setBuffer(RGB *buffer) {
-	for(int i = 0; i < width * height; i++)
-		this->buffer[i] = buffer[i];
+	for(int y = 0; y < height; y++)
+		copy_n(buffer + y * width, width, row(y));
+}
+
+RGB *Bitmap::getBuffer() {
+	return buffer;
+}
+
+// x0..x1 inclusive, clipped to the canvas
+Span Bitmap::span(int y, int x0, int x1) {
+	Span s;
+	s.begin = s.end = buffer, s.x = 0;
+	if(y < 0 || y >= height)
+		return s;
+	if(x0 > x1)
+		swap(x0, x1);
+	x0 = max(x0, 0), x1 = min(x1, width - 1);
+	if(x0 > x1)
+		return s;
+	s.begin = row(y) + x0, s.end = row(y) + x1 + 1, s.x = x0;
+	return s;
 }
 
-void Bitmap::save(const char* name) {
+// to the name given at construction
+bool Bitmap::save() {
+	return name && save(name);
+}
+
+// false if the file could not be written
+bool Bitmap::save(const char* name) {
+	PROFILE_SCOPE("Bitmap::save");
 	fstream file(name, ios::out | ios::binary);
+	if(!file)
+		return false;
+	const char zero[4] = { 0, 0, 0, 0 };
+	int pad = (4 - width * 3 % 4) % 4;
 	file.write((char*)&header, sizeof(header)); // write header
-	for(int i = 0; i < width * height; i++) // write buffer
-		file.write((char*)&buffer[i], sizeof(RGB));
+	for(int y = 0; y < height; y++) { // write buffer, rows padded to 4 bytes
+		file.write((char*)row(y), width * sizeof(RGB));
+		file.write(zero, pad);
+	}
 	file.close();
+	if(file.fail())
+		return false;
+	PROFILE_COUNT(BYTES_WRITTEN, header.file_size);
+	return true;
 }
 
 bool Bitmap::load(const char* name) {
+	PROFILE_SCOPE("Bitmap::load");
 	fstream file(name, ios::in | ios::binary);
 	if(!file)
 		return false;
@@ -366,19 +991,31 @@ bool Bitmap::load(const char* name) {
 	file.read((char*)&h, sizeof(h));
 	if(!setSize(h.width, h.height))
 		return false;
-	for(int i = 0; i < h.width * h.height; i++)
-		file.read((char*)&buffer[i], sizeof(RGB));
+	int pad = (4 - width * 3 % 4) % 4;
+	file.seekg(h.data_offset);
+	for(int y = 0; y < height; y++) {
+		file.read((char*)row(y), width * sizeof(RGB));
+		file.ignore(pad);
+	}
 	file.close();
 	return true;
 }
 
+// a view keeps its buffer, so only its own size is accepted
 bool Bitmap::setSize(int width, int height) {
+	if(!owner)
+		return width == this->width && height == this->height;
 	if(buffer)
 		delete [] buffer;
+	buffer = NULL;
+	this->width = this->height = this->stride = 0;
+	sampleIndex.clear();
+	samples.clear();
+	if(width < 0 || height < 0 || (long long)width * height > 2073600)
+		return false;
 	this->width = width;
 	this->height = height;
-	if(width * height > 2073600)
-		return false;
+	this->stride = width;
 	bitmapHeaderInit(header, width, height);
 	buffer = new RGB[width * height];
 	setOrigin(P2(width / 2 - 1, height / 2 - 1));
@@ -394,4 +1031,22 @@ void Bitmap::setColor(unsigned char R, unsigned char G, unsigned char B) {
 }
 
 
+
+/******************************************************************************/
+//  OriginView Member Functions
+/******************************************************************************/
+
+OriginView::OriginView(Bitmap& bmp) {
+	this->bmp = &bmp;
+	buffer = bmp.getBuffer();
+	width = bmp.getWidth(), height = bmp.getHeight(), stride = bmp.getStride();
+	ox = int(bmp.getOrigin().x), oy = int(bmp.getOrigin().y);
+}
+
+// x0..x1 inclusive, clipped to the canvas
+Span OriginView::span(int y, int x0, int x1) {
+	return bmp->span(y + oy, x0 + ox, x1 + ox);
+}
+
+
 #endif /* __BITMAP_H__ */
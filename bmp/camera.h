@@ -8,7 +8,7 @@ using namespace std;
 /*
 Camera
 
-direction: (0, 0, -1) you cannot change
+direction: (0, 0, -1) you cannot change; ViewCamera looks anywhere
 position: (0, 0, height)
 focus: (0, 0, height + focus)
 using geometric projection (diagram below)
@@ -30,10 +30,78 @@ public:
     void shot(TriObj&, Bitmap&, bool);  // shot triangle object
     void shot(LinObj&, Bitmap&);        // shot line object
     void shot(BezObj&, Bitmap&);        // shot bezier object
+    template<class T>
+    void shot(const Point3<T>* patches, size_t count, double scale, Point3<T> middle, Bitmap&);  // shot flat bicubic patches
     P2 proj(P3 p);      // geometric projection P3
+    template<class T>
+    Point2<T> proj(Point3<T> p);    // geometric projection in the precision of the point
     P2P proj(P3P pp);   // geometric projection P3 pair
     P2T proj(P3T pt);   // geometric projection P3 triangle
     vector<P2> proj(vector<P3>& p3v);   // geometric projection P3 array
+    ArenaVector<P2> proj(const vector<P3>& p3v, Arena& arena); // geometric projection P3 array, in the arena
+};
+
+/*
+Matrix4
+
+row-major 4 x 4 transform of homogeneous points, p' = m * (x, y, z, 1);
+a * b applies b first
+*/
+struct Matrix4 {
+    double m[4][4];
+    static Matrix4 identity();
+    static Matrix4 translate(P3 d);
+    static Matrix4 scale(double s);
+    static Matrix4 rotateX(double theta);   // degrees, as the objects' own rotations
+    static Matrix4 rotateY(double theta);
+    static Matrix4 rotateZ(double theta);
+    Matrix4 operator*(const Matrix4& b) const;
+    void apply(P3 p, double out[4]) const;
+};
+
+/*
+ViewCamera
+
+a camera anywhere: an eye, the point it looks at and which way is up,
+with a perspective or an orthographic lens. The view and the lens are
+folded into one view-projection matrix for the bitmap's height, and a
+shot multiplies the object's placement (scale, then middle, as Camera
+does) into it too, so every control point takes one matrix product.
+Models are only read: one model, loaded once, can be shot by any
+number of cameras, from any number of threads.
+
+clip space: after the divide by w, x and y are pixels from the bitmap's
+origin; z is the distance in front of the near plane, so lines are cut
+where z = 0 and nothing behind the eye is ever divided by. Lines are
+then cut to the bitmap, and solid triangles to a guard band around it,
+so a point just past the near plane cannot send the rasterizer across
+millions of pixels.
+
+    ViewCamera cam;
+    cam.lookAt(P3(600.0, -400.0, 300.0), P3(0, 0, 0), P3(0, 0, 1));
+    cam.perspective(40, 10);
+    cam.shot(teapot, bmp);
+*/
+class ViewCamera {
+public:
+    ViewCamera();
+    bool lookAt(P3 eye, P3 target, P3 up);          // false, and nothing changed, if eye == target
+    void perspective(double fov, double near);      // vertical field of view in degrees
+    void orthographic(double span, double near);    // world units across the bitmap's height
+    Matrix4 getMatrix(int rows);                    // view-projection for a bitmap `rows` high
+    bool project(P3 p, int rows, P2& out);          // false behind the near plane
+    void shot(const BezObj&, Bitmap&);              // shot bezier object
+    void shot(const BezObj&, const Matrix4& model, Bitmap&);   // placed by `model`, not its own scale and middle
+    void shot(const LinObj&, Bitmap&);              // shot line object
+    void shot(const TriObj&, Bitmap&, bool solid);  // shot triangle object
+    void shot(const vector<P3>&, Bitmap&);          // shot P3 shape (connect P3 array)
+private:
+    Matrix4 view;                   // world to eye space, from lookAt
+    bool ortho;
+    double fov, span, near;
+    void line(const double a[4], const double b[4], Bitmap& bmp);  // clip space, cut to the near plane and the bitmap
+    void fill(const P2 *corner, int n, Bitmap& bmp);                // convex polygon in pixels, cut to the guard band
+    void patches(const BezObj& obj, const Matrix4& m, Bitmap& bmp);
 };
 
 
@@ -46,11 +114,13 @@ Camera::Camera() {
 
 // shot P3 shape (connect P3 array)
 void Camera::shot(vector<P3>& p3v, Bitmap& bmp) {
+    PROFILE_SCOPE("Camera::shot P3");
     bmp.connect(proj(p3v));
 }
 
 // shot triangle object
 void Camera::shot(TriObj& tri, Bitmap& bmp, bool solid = false) {
+    PROFILE_SCOPE("Camera::shot TriObj");
     for(int i = 0; i < tri.vs.size(); i++)
         if(solid)
             bmp.sTriangle(
@@ -76,6 +146,7 @@ void Camera::shot(TriObj& tri, Bitmap& bmp, bool solid = false) {
 
 // shot line object
 void Camera::shot(LinObj& line, Bitmap& bmp) {
+    PROFILE_SCOPE("Camera::shot LinObj");
     for(int i = 0; i < line.vs.size(); i++) {
         bmp.line(
             proj(
@@ -90,7 +161,9 @@ void Camera::shot(LinObj& line, Bitmap& bmp) {
 
 // shot bezier object
 void Camera::shot(BezObj& bpt, Bitmap& bmp) {
+    PROFILE_SCOPE("Camera::shot BezObj");
     int count = bpt.data.size();
+    PROFILE_COUNT(PATCHES, count);
     for(int i = 0; i < count; i++) {
         int h = bpt.data[i].size();
         for(int j = 0; j < h; j++) {
@@ -111,6 +184,32 @@ void Camera::shot(BezObj& bpt, Bitmap& bmp) {
     }
 }
 
+// shot flat bicubic patches, 16 control points each as BezObj::tessellate
+// writes them; the same lines in the same order as shot(BezObj&). P3
+// patches draw exactly what shot(BezObj&) does; P3f and P3q ones are
+// projected and rasterized in float or fixed point
+template<class T>
+void Camera::shot(const Point3<T>* patches, size_t count, double scale, Point3<T> middle, Bitmap& bmp) {
+    PROFILE_SCOPE("Camera::shot patches");
+    PROFILE_COUNT(PATCHES, count);
+    Point3<T> s(scale, scale, scale);
+    for(size_t i = 0; i < count; i++) {
+        const Point3<T> *p = patches + 16 * i;
+        for(int j = 0; j < 4; j++)
+            for(int k = 0; k < 4; k++) {
+                Point3<T> tempc = mult(p[4 * j + k], s) + middle;
+                if(k < 3) {
+                    Point3<T> tempk = mult(p[4 * j + k + 1], s) + middle;
+                    bmp.line(proj(tempc), proj(tempk));
+                }
+                if(j < 3) {
+                    Point3<T> tempj = mult(p[4 * j + k + 4], s) + middle;
+                    bmp.line(proj(tempc), proj(tempj));
+                }
+            }
+    }
+}
+
 // geometric projection P3
 P2 Camera::proj(P3 p) {
     double dist = height - p.z;
@@ -118,6 +217,18 @@ P2 Camera::proj(P3 p) {
     return P2((zoom * p.x * focus) / fd, (zoom * p.y * focus) / fd);
 }
 
+// geometric projection in the precision of the point
+// one factor per point, focus / distance first and zoom after, so no
+// intermediate is larger than focus, height + focus or the result: in
+// 16.16 those and every model and screen coordinate must stay within
+// +-32768 (the default focus 10000 leaves any zoom that keeps the image
+// on a Bitmap)
+template<class T>
+Point2<T> Camera::proj(Point3<T> p) {
+    T k = T(focus) / (T(height + focus) - p.z) * T(zoom);
+    return Point2<T>(p.x * k, p.y * k);
+}
+
 // geometric projection P3 pair
 P2P Camera::proj(P3P pp) {
     return P2P(proj(pp.p1), proj(pp.p2));
@@ -131,11 +242,302 @@ P2T Camera::proj(P3T pt) {
 // geometric projection P3 array
 vector<P2> Camera::proj(vector<P3>& p3v) {
     vector<P2> p2v;
-    for(int i = 0; i < p2v.size(); i++)
+    p2v.reserve(p3v.size());
+    for(int i = 0; i < p3v.size(); i++)
         p2v.push_back(proj(p3v[i]));
     return p2v;
 }
 
+// geometric projection P3 array, in the arena
+ArenaVector<P2> Camera::proj(const vector<P3>& p3v, Arena& arena) {
+    ArenaVector<P2> p2v(arena);
+    p2v.reserve(p3v.size());
+    for(int i = 0; i < p3v.size(); i++)
+        p2v.push_back(proj(p3v[i]));
+    return p2v;
+}
+
+
+/******************************************************************************/
+//  Matrix4 Member Functions
+/******************************************************************************/
+
+Matrix4 Matrix4::identity() {
+    Matrix4 r;
+    for(int i = 0; i < 4; i++)
+        for(int j = 0; j < 4; j++)
+            r.m[i][j] = i == j ? 1 : 0;
+    return r;
+}
+
+Matrix4 Matrix4::translate(P3 d) {
+    Matrix4 r = identity();
+    r.m[0][3] = d.x, r.m[1][3] = d.y, r.m[2][3] = d.z;
+    return r;
+}
+
+Matrix4 Matrix4::scale(double s) {
+    Matrix4 r = identity();
+    r.m[0][0] = r.m[1][1] = r.m[2][2] = s;
+    return r;
+}
+
+// degrees, as the objects' own rotations
+Matrix4 Matrix4::rotateX(double theta) {
+    double rad = (theta * 3.1416) / 180.0;
+    Matrix4 r = identity();
+    r.m[1][1] = cos(rad), r.m[1][2] = -sin(rad);
+    r.m[2][1] = sin(rad), r.m[2][2] = cos(rad);
+    return r;
+}
+
+Matrix4 Matrix4::rotateY(double theta) {
+    double rad = (theta * 3.1416) / 180.0;
+    Matrix4 r = identity();
+    r.m[2][2] = cos(rad), r.m[2][0] = -sin(rad);
+    r.m[0][2] = sin(rad), r.m[0][0] = cos(rad);
+    return r;
+}
+
+Matrix4 Matrix4::rotateZ(double theta) {
+    double rad = (theta * 3.1416) / 180.0;
+    Matrix4 r = identity();
+    r.m[0][0] = cos(rad), r.m[0][1] = -sin(rad);
+    r.m[1][0] = sin(rad), r.m[1][1] = cos(rad);
+    return r;
+}
+
+Matrix4 Matrix4::operator*(const Matrix4& b) const {
+    Matrix4 r;
+    for(int i = 0; i < 4; i++)
+        for(int j = 0; j < 4; j++)
+            r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j] + m[i][3] * b.m[3][j];
+    return r;
+}
+
+void Matrix4::apply(P3 p, double out[4]) const {
+    for(int i = 0; i < 4; i++)
+        out[i] = m[i][0] * p.x + m[i][1] * p.y + m[i][2] * p.z + m[i][3];
+}
+
+
+/******************************************************************************/
+//  ViewCamera Member Functions
+/******************************************************************************/
+
+// from (0, 0, 1000) down -z, y up, as Camera's defaults
+ViewCamera::ViewCamera() {
+    lookAt(P3(0, 0, 1000), P3(0, 0, 0), P3(0, 1, 0));
+    perspective(45, 1);
+}
+
+// eye space: x right, y up, looking down -z
+// false, and nothing changed, if eye == target; an up along the line of
+// sight (a z-up model seen from straight above) is replaced by the world
+// axis furthest from it
+bool ViewCamera::lookAt(P3 eye, P3 target, P3 up) {
+    P3 d = target - eye;
+    if(d.len2() == 0)
+        return false;
+    P3 f = d.unit();
+    P3 s = f.cross(up);
+    if(s.len() <= 1e-9 * up.len() || up.len2() == 0) {
+        double x = fabs(f.x), y = fabs(f.y), z = fabs(f.z);
+        up = x <= y && x <= z ? P3(1, 0, 0) : y <= z ? P3(0, 1, 0) : P3(0, 0, 1);
+        s = f.cross(up);
+    }
+    s = s.unit();
+    P3 u = s.cross(f);
+    view = Matrix4::identity();
+    P3 rows[3] = { s, u, -f };
+    for(int i = 0; i < 3; i++) {
+        view.m[i][0] = rows[i].x, view.m[i][1] = rows[i].y, view.m[i][2] = rows[i].z;
+        view.m[i][3] = -(rows[i] * eye);
+    }
+    return true;
+}
+
+// vertical field of view in degrees
+void ViewCamera::perspective(double fov, double near) {
+    ortho = false;
+    this->fov = fov, this->near = near;
+}
+
+// world units across the bitmap's height
+void ViewCamera::orthographic(double span, double near) {
+    ortho = true;
+    this->span = span, this->near = near;
+}
+
+// view-projection for a bitmap `rows` high
+// x and y scaled to pixels, z = -z_eye - near, w = -z_eye (perspective) or 1
+Matrix4 ViewCamera::getMatrix(int rows) {
+    double k = ortho ? rows / span : (rows / 2.0) / tan(fov * 3.1416 / 360.0);
+    Matrix4 lens = Matrix4::identity();
+    lens.m[0][0] = lens.m[1][1] = k;
+    lens.m[2][2] = -1, lens.m[2][3] = -near;
+    if(!ortho)
+        lens.m[3][2] = -1, lens.m[3][3] = 0;
+    return lens * view;
+}
+
+// false behind the near plane
+bool ViewCamera::project(P3 p, int rows, P2& out) {
+    double c[4];
+    getMatrix(rows).apply(p, c);
+    if(c[2] < 0)
+        return false;
+    out = P2(c[0] / c[3], c[1] / c[3]);
+    return true;
+}
+
+// shot bezier object
+void ViewCamera::shot(const BezObj& obj, Bitmap& bmp) {
+    shot(obj, Matrix4::translate(obj.middle) * Matrix4::scale(obj.scale), bmp);
+}
+
+// placed by `model`, not its own scale and middle
+void ViewCamera::shot(const BezObj& obj, const Matrix4& model, Bitmap& bmp) {
+    PROFILE_SCOPE("ViewCamera::shot BezObj");
+    PROFILE_COUNT(PATCHES, obj.data.size());
+    patches(obj, getMatrix(bmp.getHeight()) * model, bmp);
+}
+
+// every control point once through m, then the same lines as Camera
+void ViewCamera::patches(const BezObj& obj, const Matrix4& m, Bitmap& bmp) {
+    vector<double> c;
+    for(int i = 0; i < int(obj.data.size()); i++) {
+        const vector< vector<P3> > &patch = obj.data[i];
+        int h = patch.size(), w = h ? patch[0].size() : 0;
+        c.resize(4 * h * w);
+        for(int j = 0; j < h; j++)
+            for(int k = 0; k < w; k++)
+                m.apply(patch[j][k], &c[4 * (j * w + k)]);
+        for(int j = 0; j < h; j++)
+            for(int k = 0; k < w; k++) {
+                const double *p = &c[4 * (j * w + k)];
+                if(k < w - 1)
+                    line(p, p + 4, bmp);
+                if(j < h - 1)
+                    line(p, p + 4 * w, bmp);
+            }
+    }
+}
+
+// shot line object; moved by middle, not scaled, as Camera does
+void ViewCamera::shot(const LinObj& lin, Bitmap& bmp) {
+    PROFILE_SCOPE("ViewCamera::shot LinObj");
+    Matrix4 m = getMatrix(bmp.getHeight()) * Matrix4::translate(lin.middle);
+    double a[4], b[4];
+    for(int i = 0; i < int(lin.vs.size()); i++) {
+        m.apply(lin.vs[i].p1, a), m.apply(lin.vs[i].p2, b);
+        line(a, b, bmp);
+    }
+}
+
+// shot triangle object
+// solid triangles are cut to the near plane too, which leaves 3 or 4
+// corners, and then to the guard band
+void ViewCamera::shot(const TriObj& tri, Bitmap& bmp, bool solid = false) {
+    PROFILE_SCOPE("ViewCamera::shot TriObj");
+    Matrix4 m = getMatrix(bmp.getHeight()) * Matrix4::translate(tri.middle) * Matrix4::scale(tri.scale);
+    for(int i = 0; i < int(tri.vs.size()); i++) {
+        double c[3][4];
+        m.apply(tri.vs[i].p1, c[0]), m.apply(tri.vs[i].p2, c[1]), m.apply(tri.vs[i].p3, c[2]);
+        if(!solid) {
+            PROFILE_COUNT(TRIANGLES, 1);
+            line(c[0], c[1], bmp), line(c[0], c[2], bmp), line(c[1], c[2], bmp);
+            continue;
+        }
+        P2 corner[4];
+        int n = 0;
+        for(int j = 0; j < 3; j++) {
+            const double *a = c[j], *b = c[(j + 1) % 3];
+            if(a[2] >= 0)
+                corner[n++] = P2(a[0] / a[3], a[1] / a[3]);
+            if((a[2] >= 0) != (b[2] >= 0)) {
+                double s = a[2] / (a[2] - b[2]), q[4];
+                for(int e = 0; e < 4; e++)
+                    q[e] = a[e] + (b[e] - a[e]) * s;
+                corner[n++] = P2(q[0] / q[3], q[1] / q[3]);
+            }
+        }
+        fill(corner, n, bmp);
+    }
+}
+
+// shot P3 shape (connect P3 array)
+void ViewCamera::shot(const vector<P3>& p3v, Bitmap& bmp) {
+    PROFILE_SCOPE("ViewCamera::shot P3");
+    Matrix4 m = getMatrix(bmp.getHeight());
+    int n = p3v.size();
+    for(int i = 0; i < n; i++) {
+        double a[4], b[4];
+        m.apply(p3v[i], a), m.apply(p3v[(i + 1) % n], b);
+        line(a, b, bmp);
+    }
+}
+
+// clip space, cut to the near plane (z >= 0), then to the bitmap with a
+// pixel to spare (Liang-Barsky), so lines leave the edge as before
+void ViewCamera::line(const double a[4], const double b[4], Bitmap& bmp) {
+    if(a[2] < 0 && b[2] < 0)
+        return;
+    double p[4], q[4];
+    copy(a, a + 4, p), copy(b, b + 4, q);
+    if(a[2] < 0 || b[2] < 0) {
+        double s = a[2] / (a[2] - b[2]);
+        double *cut = a[2] < 0 ? p : q;
+        for(int e = 0; e < 4; e++)
+            cut[e] = a[e] + (b[e] - a[e]) * s;
+    }
+    P2 u(p[0] / p[3], p[1] / p[3]), v(q[0] / q[3], q[1] / q[3]), o = bmp.getOrigin();
+    double lo[2] = { -o.x - 1, -o.y - 1 }, hi[2] = { bmp.getWidth() - o.x + 1, bmp.getHeight() - o.y + 1 };
+    double from[2] = { u.x, u.y }, d[2] = { v.x - u.x, v.y - u.y }, t0 = 0, t1 = 1;
+    for(int e = 0; e < 2; e++) {
+        if(d[e] == 0) {
+            if(from[e] < lo[e] || from[e] > hi[e])
+                return;
+            continue;
+        }
+        double ta = (lo[e] - from[e]) / d[e], tb = (hi[e] - from[e]) / d[e];
+        if(ta > tb)
+            swap(ta, tb);
+        t0 = max(t0, ta), t1 = min(t1, tb);
+        if(t0 > t1)
+            return;
+    }
+    P2 delta = v - u;
+    bmp.line(t0 > 0 ? u + delta * t0 : u, t1 < 1 ? u + delta * t1 : v);
+}
+
+// convex polygon in pixels from the bitmap's origin, cut to a guard band
+// one bitmap wide on every side (Sutherland-Hodgman), then drawn as a
+// fan; a polygon inside the band keeps its corners and order, so only
+// triangles reaching far off the bitmap are cut at all
+void ViewCamera::fill(const P2 *corner, int n, Bitmap& bmp) {
+    P2 o = bmp.getOrigin();
+    double w = bmp.getWidth(), h = bmp.getHeight();
+    double lo[2] = { -o.x - w, -o.y - h }, hi[2] = { 2 * w - o.x, 2 * h - o.y };
+    P2 a[8], b[8];  // 4 corners, one more per side at most
+    copy(corner, corner + n, a);
+    for(int side = 0; side < 4 && n > 0; side++) {
+        int e = side & 1, m = 0;
+        double edge = side < 2 ? lo[e] : hi[e], sign = side < 2 ? 1 : -1;
+        for(int i = 0; i < n; i++) {
+            P2 p = a[(i + n - 1) % n], q = a[i];
+            double dp = sign * ((e ? p.y : p.x) - edge), dq = sign * ((e ? q.y : q.x) - edge);
+            if((dp >= 0) != (dq >= 0))
+                b[m++] = p + (q - p) * (dp / (dp - dq));
+            if(dq >= 0)
+                b[m++] = q;
+        }
+        copy(b, b + m, a);
+        n = m;
+    }
+    for(int i = 1; i + 1 < n; i++)
+        bmp.sTriangle(a[0], a[i], a[i + 1]);
+}
 
 
 #endif /* __CAMERA_H__ */
@@ -0,0 +1,263 @@
+#ifndef __CONVOLUTION_H__
+#define __CONVOLUTION_H__
+
+#include <vector>
+#include <cmath>
+#include "color.h"
+using namespace std;
+
+/*
+Kernel
+
+w x h weights (both odd), centered on the output pixel
+result = sum(weight * pixel) / divisor + bias
+
+A rank-1 kernel (every row is a multiple of one row) is run as a
+vertical pass followed by a horizontal pass, O(w + h) instead of O(w * h).
+*/
+class Kernel {
+public:
+    int w, h;
+    vector<double> k;   // weights, row major
+    double divisor;
+    double bias;
+
+    Kernel();
+    Kernel(int w, int h);
+    Kernel(int w, int h, const int *weights, double divisor, double bias);
+    Kernel(int w, int h, const double *weights, double divisor, double bias);
+    double& at(int x, int y);   // weight at column x, row y
+    bool separable();           // rank-1 test
+    bool separable(vector<double>& row, vector<double>& col); // rank-1 test, k = col * row
+    static Kernel sharpen();
+    static Kernel emboss();
+    static Kernel sobelX();
+    static Kernel sobelY();
+    static Kernel box(int r);
+    static Kernel gaussian(int r);
+};
+
+/*
+Convolver
+
+Kernel compiled to fixed-point weights (Q12), works on one output row at a time.
+`src` points at the first output pixel of the row, the `rx` columns on either
+side and the `ry` rows above and below must be readable (padded by the caller).
+The inner loops run over whole rows of interleaved B G R bytes so that they
+vectorize.
+*/
+class Convolver {
+public:
+    int rx, ry;
+
+    Convolver(Kernel& kernel, bool separable);
+    bool isSeparable();
+    void row(const RGB *src, int stride, int w, int *out); // unclamped B G R values
+    void row(const RGB *src, int stride, int w, RGB *dst); // clamped
+private:
+    static const int FIX = 12;
+    bool sep;
+    int kw, kh;
+    vector<int> hq, vq, kq; // row, column and full weights
+    long long gq, bq;       // gain, bias and rounding in the final shift
+    int shift;
+    vector<int> tmp, acc, res;
+};
+
+
+/******************************************************************************/
+//  Kernel Member Functions
+/******************************************************************************/
+
+Kernel::Kernel() {
+    w = h = 1;
+    k.assign(1, 1.0);
+    divisor = 1, bias = 0;
+}
+
+Kernel::Kernel(int w, int h) {
+    this->w = w, this->h = h;
+    k.assign(w * h, 0.0);
+    divisor = 1, bias = 0;
+}
+
+Kernel::Kernel(int w, int h, const int *weights, double divisor = 1, double bias = 0) {
+    this->w = w, this->h = h;
+    for(int i = 0; i < w * h; i++)
+        k.push_back(double(weights[i]));
+    this->divisor = divisor, this->bias = bias;
+}
+
+Kernel::Kernel(int w, int h, const double *weights, double divisor = 1, double bias = 0) {
+    this->w = w, this->h = h;
+    k.assign(weights, weights + w * h);
+    this->divisor = divisor, this->bias = bias;
+}
+
+// weight at column x, row y
+double& Kernel::at(int x, int y) {
+    return k[y * w + x];
+}
+
+// rank-1 test
+bool Kernel::separable() {
+    vector<double> row, col;
+    return separable(row, col);
+}
+
+// rank-1 test, k = col * row
+bool Kernel::separable(vector<double>& row, vector<double>& col) {
+    int px = 0, py = 0;
+    double big = 0;
+    for(int y = 0; y < h; y++)
+        for(int x = 0; x < w; x++)
+            if(fabs(at(x, y)) > big)
+                big = fabs(at(x, y)), px = x, py = y;
+    if(big == 0)
+        return false;
+    row.resize(w), col.resize(h);
+    for(int x = 0; x < w; x++)
+        row[x] = at(x, py) / at(px, py);
+    for(int y = 0; y < h; y++)
+        col[y] = at(px, y);
+    for(int y = 0; y < h; y++)
+        for(int x = 0; x < w; x++)
+            if(fabs(at(x, y) - col[y] * row[x]) > big * 1e-9)
+                return false;
+    return true;
+}
+
+Kernel Kernel::sharpen() {
+    int k[] = { 0, -1,  0,
+               -1,  5, -1,
+                0, -1,  0 };
+    return Kernel(3, 3, k);
+}
+
+Kernel Kernel::emboss() {
+    int k[] = {-2, -1,  0,
+               -1,  1,  1,
+                0,  1,  2 };
+    return Kernel(3, 3, k);
+}
+
+Kernel Kernel::sobelX() {
+    int k[] = {-1,  0,  1,
+               -2,  0,  2,
+               -1,  0,  1 };
+    return Kernel(3, 3, k);
+}
+
+Kernel Kernel::sobelY() {
+    int k[] = {-1, -2, -1,
+                0,  0,  0,
+                1,  2,  1 };
+    return Kernel(3, 3, k);
+}
+
+Kernel Kernel::box(int r) {
+    Kernel kernel(2 * r + 1, 2 * r + 1);
+    kernel.k.assign(kernel.w * kernel.h, 1.0);
+    kernel.divisor = kernel.w * kernel.h;
+    return kernel;
+}
+
+Kernel Kernel::gaussian(int r) {
+    Kernel kernel(2 * r + 1, 2 * r + 1);
+    double sigma = r > 1 ? r / 2.0 : 0.75, sum = 0;
+    for(int y = -r; y <= r; y++)
+        for(int x = -r; x <= r; x++)
+            sum += kernel.at(x + r, y + r) = exp(-(x * x + y * y) / (2 * sigma * sigma));
+    kernel.divisor = sum;
+    return kernel;
+}
+
+
+/******************************************************************************/
+//  Convolver Member Functions
+/******************************************************************************/
+
+Convolver::Convolver(Kernel& kernel, bool separable = true) {
+    kw = kernel.w, kh = kernel.h;
+    rx = kw / 2, ry = kh / 2;
+    vector<double> row, col;
+    sep = separable && kernel.separable(row, col);
+    double gain = 0;
+    if(sep) {
+        // both passes normalized to sum |w| = 1 so Q12 cannot overflow
+        double sr = 0, sc = 0;
+        for(int i = 0; i < kw; i++) sr += fabs(row[i]);
+        for(int i = 0; i < kh; i++) sc += fabs(col[i]);
+        for(int i = 0; i < kw; i++) hq.push_back(int(floor(row[i] / sr * (1 << FIX) + 0.5)));
+        for(int i = 0; i < kh; i++) vq.push_back(int(floor(col[i] / sc * (1 << FIX) + 0.5)));
+        gain = sr * sc;
+        shift = 2 * FIX - 4 + 16; // vertical result is kept in Q8
+    } else {
+        double s = 0;
+        for(int i = 0; i < kw * kh; i++) s += fabs(kernel.k[i]);
+        for(int i = 0; i < kw * kh; i++)
+            kq.push_back(s == 0 ? 0 : int(floor(kernel.k[i] / s * (1 << FIX) + 0.5)));
+        gain = s;
+        shift = FIX + 16;
+    }
+    gq = (long long)floor(gain / kernel.divisor * 65536 + 0.5);
+    bq = ((long long)floor(kernel.bias * 65536 + 0.5) << (shift - 16)) + (1LL << (shift - 1));
+}
+
+bool Convolver::isSeparable() {
+    return sep;
+}
+
+// unclamped B G R values
+void Convolver::row(const RGB *src, int stride, int w, int *out) {
+    int n = w * 3;
+    acc.assign(n, 0);
+    if(sep) {
+        int m = (w + 2 * rx) * 3;
+        tmp.assign(m, 0);
+        for(int j = 0; j < kh; j++) {
+            int q = vq[j];
+            if(q == 0)
+                continue;
+            const unsigned char *p = (const unsigned char*)(src + (j - ry) * stride - rx);
+            for(int c = 0; c < m; c++)
+                tmp[c] += q * p[c];
+        }
+        for(int c = 0; c < m; c++)
+            tmp[c] = (tmp[c] + 8) >> 4;
+        for(int i = 0; i < kw; i++) {
+            int q = hq[i];
+            if(q == 0)
+                continue;
+            const int *t = &tmp[i * 3];
+            for(int c = 0; c < n; c++)
+                acc[c] += q * t[c];
+        }
+    } else {
+        for(int j = 0; j < kh; j++) {
+            const unsigned char *p = (const unsigned char*)(src + (j - ry) * stride - rx);
+            for(int i = 0; i < kw; i++) {
+                int q = kq[j * kw + i];
+                if(q == 0)
+                    continue;
+                const unsigned char *t = p + i * 3;
+                for(int c = 0; c < n; c++)
+                    acc[c] += q * t[c];
+            }
+        }
+    }
+    for(int c = 0; c < n; c++)
+        out[c] = int((acc[c] * gq + bq) >> shift);
+}
+
+// clamped
+void Convolver::row(const RGB *src, int stride, int w, RGB *dst) {
+    res.resize(w * 3);
+    row(src, stride, w, &res[0]);
+    unsigned char *d = (unsigned char*)dst;
+    for(int c = 0; c < w * 3; c++)
+        d[c] = (unsigned char)(res[c] < 0 ? 0 : (res[c] > 255 ? 255 : res[c]));
+}
+
+
+#endif /* __CONVOLUTION_H__ */
@@ -0,0 +1,111 @@
+#ifndef __FIXED_H__
+#define __FIXED_H__
+
+#include <cstdint>
+#include <climits>
+
+/*
+Fixed
+
+16.16 fixed point: a 32-bit integer counting 1/65536ths, about +-32768
+in steps of 0.000015, which holds the model and screen coordinates of
+every scene here. Products and quotients are taken in 64 bits; a sum or
+product out of range wraps, while a quotient out of range (or by zero)
+and an int or double out of range saturate, and NaN becomes 0.
+Conversions to double and int are explicit so that mixed arithmetic
+always happens in Fixed; int() rounds toward zero like int(double) does.
+*/
+class Fixed {
+public:
+    int32_t raw;
+
+    Fixed() {}
+    Fixed(int n);                       // saturated
+    Fixed(double d);                    // rounded to the nearest step, saturated
+    static Fixed fromRaw(int32_t raw);
+    explicit operator double() const;
+    explicit operator float() const;
+    explicit operator int() const;      // toward zero
+    Fixed operator+(Fixed f) const;
+    Fixed operator-(Fixed f) const;
+    Fixed operator-() const;
+    Fixed operator*(Fixed f) const;
+    Fixed operator/(Fixed f) const;
+    Fixed operator+=(Fixed f);
+    Fixed operator-=(Fixed f);
+    bool operator==(Fixed f) const { return raw == f.raw; }
+    bool operator!=(Fixed f) const { return raw != f.raw; }
+    bool operator<(Fixed f) const { return raw < f.raw; }
+    bool operator>(Fixed f) const { return raw > f.raw; }
+    bool operator<=(Fixed f) const { return raw <= f.raw; }
+    bool operator>=(Fixed f) const { return raw >= f.raw; }
+};
+
+
+/*
+Fixed Member Functions
+*/
+
+// saturated
+Fixed::Fixed(int n) {
+    raw = n >= 32768 ? INT32_MAX : n < -32768 ? INT32_MIN : int32_t(uint32_t(n) << 16);
+}
+
+// rounded to the nearest step, saturated
+Fixed::Fixed(double d) {
+    double r = d * 65536.0 + (d < 0 ? -0.5 : 0.5);
+    raw = r >= 2147483647.0 ? INT32_MAX : r <= -2147483648.0 ? INT32_MIN : r == r ? int32_t(r) : 0;
+}
+
+Fixed Fixed::fromRaw(int32_t raw) {
+    Fixed f;
+    f.raw = raw;
+    return f;
+}
+
+Fixed::operator double() const {
+    return raw / 65536.0;
+}
+
+Fixed::operator float() const {
+    return raw / 65536.0f;
+}
+
+// toward zero
+Fixed::operator int() const {
+    return raw >= 0 ? raw >> 16 : -int(uint32_t(-int64_t(raw)) >> 16);
+}
+
+Fixed Fixed::operator+(Fixed f) const {
+    return fromRaw(int32_t(uint32_t(raw) + uint32_t(f.raw)));
+}
+
+Fixed Fixed::operator-(Fixed f) const {
+    return fromRaw(int32_t(uint32_t(raw) - uint32_t(f.raw)));
+}
+
+Fixed Fixed::operator-() const {
+    return fromRaw(int32_t(0u - uint32_t(raw)));
+}
+
+Fixed Fixed::operator*(Fixed f) const {
+    return fromRaw(int32_t((int64_t(raw) * f.raw) >> 16));
+}
+
+Fixed Fixed::operator/(Fixed f) const {
+    if(f.raw == 0)
+        return fromRaw(raw >= 0 ? INT32_MAX : INT32_MIN);
+    int64_t q = int64_t(raw) * 65536 / f.raw;
+    return fromRaw(q > INT32_MAX ? INT32_MAX : q < INT32_MIN ? INT32_MIN : int32_t(q));
+}
+
+Fixed Fixed::operator+=(Fixed f) {
+    return *this = *this + f;
+}
+
+Fixed Fixed::operator-=(Fixed f) {
+    return *this = *this - f;
+}
+
+
+#endif /* __FIXED_H__ */
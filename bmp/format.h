@@ -0,0 +1,301 @@
+#ifndef __FORMAT_H__
+#define __FORMAT_H__
+
+#include <vector>
+#include <cstddef>
+#include "bitmap.h"
+#include "lut.h"
+#include "layer.h"
+using namespace std;
+
+/*
+pixel formats
+
+a format says how the channels of a row are laid out
+
+    BGR24   B G R B G R ...         packed, Bitmap's own layout
+    BGRX32  B G R X B G R X ...     packed, 4 bytes, rows 32-byte aligned
+    Planar  B B B ... / G G G ... / R R R ...   one plane per channel
+
+kernels are written once against channel(c, y) and the STEP of the
+format, and the compiler turns the constant step into plain vector loads
+for BGRX32 and Planar instead of the 3-byte shuffles BGR24 needs.
+Bitmap stays BGR24; PixelImage converts only in from()/to(), which is
+also what load() and save() go through.
+*/
+struct BGR24 { enum { STEP = 3, PLANES = 1, ALIGN = 4 }; };
+struct BGRX32 { enum { STEP = 4, PLANES = 1, ALIGN = 32 }; };
+struct Planar { enum { STEP = 1, PLANES = 3, ALIGN = 32 }; };
+
+template<class F>
+class PixelImage {
+public:
+    PixelImage(int width, int height);
+    PixelImage(Bitmap& bmp);
+    ~PixelImage();
+    int getWidth();
+    int getHeight();
+    int stride();                           // bytes between two rows of a plane
+    unsigned char *channel(int c, int y);   // channel c (0 B, 1 G, 2 R) of pixel (0, y), pixels STEP bytes apart
+    void setSize(int width, int height);
+    void from(Bitmap& bmp);                 // convert from BGR24, resizing
+    bool to(Bitmap& bmp);                   // convert to BGR24, resizing; false if bmp cannot take the size
+    bool load(const char *name);
+    bool save(const char *name);
+private:
+    int width, height, pitch;
+    size_t plane;                           // bytes per plane
+    unsigned char *memory, *data;
+    PixelImage(const PixelImage&);
+    PixelImage& operator=(const PixelImage&);
+};
+
+template<class F> void apply(ColorLUT& lut, PixelImage<F>& img);   // ColorLUT::apply
+template<class F> void boxBlur(PixelImage<F>& img, int r);          // separable (2r+1)^2 box, clamped border
+template<class F> void composite(PixelImage<F>& base, Layer& layer); // ::composite
+
+
+/******************************************************************************/
+//  PixelImage Member Functions
+/******************************************************************************/
+
+template<class F>
+PixelImage<F>::PixelImage(int width, int height) {
+    memory = data = NULL;
+    setSize(width, height);
+}
+
+template<class F>
+PixelImage<F>::PixelImage(Bitmap& bmp) {
+    memory = data = NULL;
+    from(bmp);
+}
+
+template<class F>
+PixelImage<F>::~PixelImage() {
+    delete [] memory;
+}
+
+template<class F>
+int PixelImage<F>::getWidth() {
+    return width;
+}
+
+template<class F>
+int PixelImage<F>::getHeight() {
+    return height;
+}
+
+// bytes between two rows of a plane
+template<class F>
+int PixelImage<F>::stride() {
+    return pitch;
+}
+
+// channel c (0 B, 1 G, 2 R) of pixel (0, y), pixels STEP bytes apart
+template<class F>
+unsigned char *PixelImage<F>::channel(int c, int y) {
+    if(F::PLANES == 1)
+        return data + y * pitch + c;
+    return data + c * plane + y * pitch;
+}
+
+template<class F>
+void PixelImage<F>::setSize(int width, int height) {
+    this->width = width, this->height = height;
+    pitch = (width * F::STEP + F::ALIGN - 1) / F::ALIGN * F::ALIGN;
+    plane = size_t(pitch) * height;
+    delete [] memory;
+    memory = new unsigned char[plane * F::PLANES + F::ALIGN];
+    data = memory + (F::ALIGN - size_t(memory) % F::ALIGN) % F::ALIGN;
+    for(size_t i = 0; i < plane * F::PLANES; i++)
+        data[i] = F::STEP == 4 && i % 4 == 3 ? 255 : 0;
+}
+
+// convert from BGR24, resizing
+template<class F>
+void PixelImage<F>::from(Bitmap& bmp) {
+    if(!data || width != bmp.getWidth() || height != bmp.getHeight())
+        setSize(bmp.getWidth(), bmp.getHeight());
+    for(int y = 0; y < height; y++) {
+        const unsigned char *s = (const unsigned char*)bmp.row(y);
+        for(int c = 0; c < 3; c++) {
+            unsigned char *d = channel(c, y);
+            for(int x = 0; x < width; x++)
+                d[x * F::STEP] = s[x * 3 + c];
+        }
+    }
+}
+
+// convert to BGR24, resizing; false if bmp cannot take the size
+template<class F>
+bool PixelImage<F>::to(Bitmap& bmp) {
+    if((bmp.getWidth() != width || bmp.getHeight() != height) && !bmp.setSize(width, height))
+        return false;
+    for(int y = 0; y < height; y++) {
+        unsigned char *d = (unsigned char*)bmp.row(y);
+        for(int c = 0; c < 3; c++) {
+            const unsigned char *s = channel(c, y);
+            for(int x = 0; x < width; x++)
+                d[x * 3 + c] = s[x * F::STEP];
+        }
+    }
+    return true;
+}
+
+template<class F>
+bool PixelImage<F>::load(const char *name) {
+    Bitmap bmp(1, 1);
+    if(!bmp.load(name))
+        return false;
+    from(bmp);
+    return true;
+}
+
+template<class F>
+bool PixelImage<F>::save(const char *name) {
+    Bitmap bmp(1, 1);
+    if(!to(bmp))
+        return false;
+    return bmp.save(name);
+}
+
+
+/******************************************************************************/
+//  Kernels
+/******************************************************************************/
+
+// ColorLUT::apply
+template<class F>
+void apply(ColorLUT& lut, PixelImage<F>& img) {
+    int w = img.getWidth();
+    bool swapped = lut.src[0] != 0 || lut.src[1] != 1 || lut.src[2] != 2;
+    vector<unsigned char> in(swapped ? w * 3 : 0);
+    for(int y = 0; y < img.getHeight(); y++) {
+        if(swapped) // channels read each other, keep the originals of this row
+            for(int c = 0; c < 3; c++)
+                for(int x = 0; x < w; x++)
+                    in[c * w + x] = img.channel(c, y)[x * F::STEP];
+        for(int c = 0; c < 3; c++) {
+            const unsigned char *t = c == 0 ? lut.B : (c == 1 ? lut.G : lut.R);
+            unsigned char *d = img.channel(c, y);
+            if(swapped) {
+                const unsigned char *s = &in[lut.src[c] * w];
+                for(int x = 0; x < w; x++)
+                    d[x * F::STEP] = t[s[x]];
+            } else
+                for(int x = 0; x < w; x++)
+                    d[x * F::STEP] = t[d[x * F::STEP]];
+        }
+    }
+}
+
+// separable (2r+1)^2 box, clamped border
+// the vertical pass works on whole rows of bytes, every channel at
+// once; the horizontal pass is a running sum along each channel
+template<class F>
+void boxBlur(PixelImage<F>& img, int r) {
+    int w = img.getWidth(), h = img.getHeight(), n = 2 * r + 1;
+    if(r <= 0 || w <= 0 || h <= 0)
+        return;
+    int inv = ((1 << 22) + n / 2) / n, half = 1 << 21;  // (v * inv + half) >> 22 is v / n rounded
+    int bytes = w * F::STEP;
+    vector<int> sum(bytes);
+    vector<unsigned char> rows(size_t(bytes) * h), line(w + 2 * r);
+    for(int p = 0; p < F::PLANES; p++) {
+        // vertical, the original rows are copied once so the output can go in place
+        for(int y = 0; y < h; y++) {
+            const unsigned char *s = img.channel(p, y);
+            for(int i = 0; i < bytes; i++)
+                rows[size_t(y) * bytes + i] = s[i];
+        }
+        for(int i = 0; i < bytes; i++)
+            sum[i] = (r + 1) * rows[i];
+        for(int k = 1; k <= r; k++) {
+            const unsigned char *s = &rows[size_t(k < h ? k : h - 1) * bytes];
+            for(int i = 0; i < bytes; i++)
+                sum[i] += s[i];
+        }
+        for(int y = 0; y < h; y++) {
+            unsigned char *d = img.channel(p, y);
+            for(int i = 0; i < bytes; i++)
+                d[i] = (unsigned char)((sum[i] * inv + half) >> 22);
+            const unsigned char *add = &rows[size_t(y + r + 1 < h ? y + r + 1 : h - 1) * bytes];
+            const unsigned char *sub = &rows[size_t(y - r > 0 ? y - r : 0) * bytes];
+            for(int i = 0; i < bytes; i++)
+                sum[i] += add[i] - sub[i];
+        }
+        // horizontal
+        for(int c = p; c < 3; c += F::PLANES)
+            for(int y = 0; y < h; y++) {
+                unsigned char *d = img.channel(c, y);
+                for(int x = 0; x < w; x++)
+                    line[x + r] = d[x * F::STEP];
+                for(int x = 0; x < r; x++)
+                    line[x] = line[r], line[w + r + x] = line[w + r - 1];
+                int s = 0;
+                for(int x = 0; x < n; x++)
+                    s += line[x];
+                for(int x = 0; x < w; x++) {
+                    d[x * F::STEP] = (unsigned char)((s * inv + half) >> 22);
+                    if(x + 1 < w)
+                        s += line[x + n] - line[x];
+                }
+            }
+    }
+}
+
+// ::composite
+template<class F>
+void composite(PixelImage<F>& base, Layer& layer) {
+    int W = base.getWidth(), H = base.getHeight();
+    int x0 = layer.x < 0 ? 0 : layer.x, x1 = layer.x + layer.getWidth() > W ? W : layer.x + layer.getWidth();
+    if(x0 >= x1)
+        return;
+    int n = x1 - x0;
+    vector<unsigned char> faded(layer.opacity != 255 ? n * 4 : 0);
+    for(int y = 0; y < H; y++) {
+        int ly = y - layer.y;
+        if(ly < 0 || ly >= layer.getHeight())
+            continue;
+        const unsigned char *p = (const unsigned char*)(layer.getBuffer() + ly * layer.getWidth() + x0 - layer.x);
+        if(layer.opacity != 255) {
+            for(int i = 0; i < n * 4; i++)
+                faded[i] = (unsigned char)div255(p[i] * layer.opacity);
+            p = &faded[0];
+        }
+        for(int c = 0; c < 3; c++) {
+            unsigned char *d = base.channel(c, y) + x0 * F::STEP;
+            const unsigned char *s = p + c, *a = p + 3;
+            switch(layer.mode) {
+                case ADD:
+                    for(int i = 0; i < n; i++) {
+                        int v = d[i * F::STEP] + s[i * 4];
+                        d[i * F::STEP] = (unsigned char)(v > 255 ? 255 : v);
+                    }
+                    break;
+                case MULTIPLY:
+                    for(int i = 0; i < n; i++) {
+                        int v = d[i * F::STEP];
+                        d[i * F::STEP] = (unsigned char)(div255(s[i * 4] * v) + div255(v * (255 - a[i * 4])));
+                    }
+                    break;
+                case SCREEN:
+                    for(int i = 0; i < n; i++) {
+                        int v = d[i * F::STEP];
+                        d[i * F::STEP] = (unsigned char)(s[i * 4] + v - div255(s[i * 4] * v));
+                    }
+                    break;
+                default:
+                    for(int i = 0; i < n; i++) {
+                        int v = s[i * 4] + div255(d[i * F::STEP] * (255 - a[i * 4]));
+                        d[i * F::STEP] = (unsigned char)(v > 255 ? 255 : v);
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+
+#endif /* __FORMAT_H__ */
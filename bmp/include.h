@@ -6,4 +6,17 @@
 #include <ctime>
 #include <cmath>
 #include "camera.h"
-#include "processor.h"
\ No newline at end of file
+#include "processor.h"
+#include "pipeline.h"
+#include "resample.h"
+#include "lut.h"
+#include "layer.h"
+#include "format.h"
+#include "indexed.h"
+#include "profile.h"
+#include "batch.h"
+#include "sink.h"
+#include "animation.h"
+#include "taskgraph.h"
+#include "arena.h"
+#include "fixed.h"
\ No newline at end of file
@@ -0,0 +1,420 @@
+#ifndef __INDEXED_H__
+#define __INDEXED_H__
+
+#include <fstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include "bitmap.h"
+using namespace std;
+
+/*
+IndexedBitmap
+
+palette image with 1, 4 or 8 bits per pixel. Rows are stored packed and
+padded to 4 bytes exactly as a BMP stores them (row 0 is the bottom row,
+like Bitmap), so save() writes the rows as they are and an 8-bit frame
+takes a third of a Bitmap's memory.
+
+quantize() builds the palette from a true-color Bitmap: when the image
+has no more colors than the depth allows (line art, flat shading) the
+palette is exact, otherwise it is a median cut over a 5-bit-per-channel
+histogram, and pixels are mapped through a 32K-entry table of nearest
+palette entries.
+
+BMP save/load covers uncompressed 1/4/8 bpp and RLE8.
+*/
+class IndexedBitmap {
+public:
+    IndexedBitmap(int width, int height, int depth);
+    bool setSize(int width, int height, int depth);
+    int getWidth();
+    int getHeight();
+    int getDepth();
+    int stride();                               // bytes per row
+    unsigned char *row(int y);                  // packed indices of row y
+    int get(int x, int y);                      // palette index, buffer coordinates
+    void set(int x, int y, int index);
+    vector<RGB>& palette();                     // at most 1 << depth entries
+    int quantize(Bitmap& bmp);                  // palette + indices from bmp, returns colors used, 0 if too large
+    bool expand(Bitmap& bmp);                   // back to true color; false if bmp cannot take the size
+    bool save(const char *name, bool rle);      // rle: RLE8, depth 8 only
+    bool load(const char *name);
+private:
+    int width, height, depth, pitch;
+    vector<unsigned char> data;
+    vector<RGB> colors;
+    // color box of the median cut, 5 bits per channel
+    struct Box {
+        int lo[3], hi[3];
+        int count;
+    };
+    void shrink(Box& b, vector<int>& hist);     // fit box to the colors it holds
+    void encodeRLE8(int y, vector<unsigned char>& out);
+};
+
+
+/******************************************************************************/
+//  IndexedBitmap Member Functions
+/******************************************************************************/
+
+IndexedBitmap::IndexedBitmap(int width, int height, int depth = 8) {
+    this->width = this->height = pitch = 0, this->depth = 8;
+    setSize(width, height, depth);
+}
+
+// false, and nothing changed, past Bitmap's pixel limit
+bool IndexedBitmap::setSize(int width, int height, int depth = 8) {
+    if(depth != 1 && depth != 4 && depth != 8)
+        return false;
+    if(width < 0 || height < 0 || (long long)width * height > 2073600)
+        return false;
+    this->width = width, this->height = height, this->depth = depth;
+    pitch = (width * depth + 31) / 32 * 4;
+    data.assign(size_t(pitch) * height, 0);
+    if(int(colors.size()) > 1 << depth)
+        colors.resize(1 << depth);
+    return true;
+}
+
+int IndexedBitmap::getWidth() {
+    return width;
+}
+
+int IndexedBitmap::getHeight() {
+    return height;
+}
+
+int IndexedBitmap::getDepth() {
+    return depth;
+}
+
+// bytes per row
+int IndexedBitmap::stride() {
+    return pitch;
+}
+
+// packed indices of row y
+unsigned char *IndexedBitmap::row(int y) {
+    return data.data() + size_t(y) * pitch;
+}
+
+// palette index, buffer coordinates
+int IndexedBitmap::get(int x, int y) {
+    if(x < 0 || y < 0 || x >= width || y >= height)
+        return 0;
+    const unsigned char *r = row(y);
+    if(depth == 8)
+        return r[x];
+    int per = 8 / depth, shift = 8 - depth * (x % per + 1);
+    return (r[x / per] >> shift) & ((1 << depth) - 1);
+}
+
+void IndexedBitmap::set(int x, int y, int index) {
+    if(x < 0 || y < 0 || x >= width || y >= height)
+        return;
+    unsigned char *r = row(y);
+    if(depth == 8) {
+        r[x] = (unsigned char)index;
+        return;
+    }
+    int per = 8 / depth, shift = 8 - depth * (x % per + 1), mask = ((1 << depth) - 1) << shift;
+    r[x / per] = (unsigned char)((r[x / per] & ~mask) | ((index << shift) & mask));
+}
+
+// at most 1 << depth entries
+vector<RGB>& IndexedBitmap::palette() {
+    return colors;
+}
+
+// palette + indices from bmp, returns colors used, 0 if too large
+int IndexedBitmap::quantize(Bitmap& bmp) {
+    if((width != bmp.getWidth() || height != bmp.getHeight()) && !setSize(bmp.getWidth(), bmp.getHeight(), depth))
+        return 0;
+    int limit = 1 << depth;
+    // exact palette when the image has few enough colors
+    map<int, int> exact;
+    for(int y = 0, last = -1; y < height && int(exact.size()) <= limit; y++) {
+        const RGB *src = bmp.row(y);
+        for(int x = 0; x < width; x++) {
+            int key = (src[x].R << 16) | (src[x].G << 8) | src[x].B;
+            if(key != last)
+                exact.insert(make_pair(key, 0)), last = key;
+        }
+    }
+    if(int(exact.size()) <= limit) {
+        colors.clear();
+        for(map<int, int>::iterator it = exact.begin(); it != exact.end(); ++it) {
+            it->second = colors.size();
+            colors.push_back(RGB(it->first));
+        }
+        int last = -1, index = 0;
+        for(int y = 0; y < height; y++)
+            for(int x = 0; x < width; x++) {
+                const RGB& c = bmp.row(y)[x];
+                int key = (c.R << 16) | (c.G << 8) | c.B;
+                if(key != last)
+                    last = key, index = exact[key];
+                set(x, y, index);
+            }
+        return colors.size();
+    }
+    // median cut on a 5-bit histogram
+    vector<int> hist(1 << 15, 0), sums(3 << 15, 0);  // pixels and their channel sums per cell
+    for(int y = 0; y < height; y++) {
+        const RGB *src = bmp.row(y);
+        for(int x = 0; x < width; x++) {
+            int k = ((src[x].R >> 3) << 10) | ((src[x].G >> 3) << 5) | (src[x].B >> 3);
+            hist[k]++;
+            sums[k * 3] += src[x].R, sums[k * 3 + 1] += src[x].G, sums[k * 3 + 2] += src[x].B;
+        }
+    }
+    vector<Box> boxes(1);
+    for(int c = 0; c < 3; c++)
+        boxes[0].lo[c] = 0, boxes[0].hi[c] = 31;
+    shrink(boxes[0], hist);
+    while(int(boxes.size()) < limit) {
+        // split the box with the most pixels along its longest side
+        int pick = -1;
+        for(int i = 0; i < int(boxes.size()); i++) {
+            Box& b = boxes[i];
+            if(b.lo[0] == b.hi[0] && b.lo[1] == b.hi[1] && b.lo[2] == b.hi[2])
+                continue;
+            if(pick < 0 || b.count > boxes[pick].count)
+                pick = i;
+        }
+        if(pick < 0)
+            break;
+        Box b = boxes[pick];
+        int axis = 0;
+        for(int c = 1; c < 3; c++)
+            if(b.hi[c] - b.lo[c] > b.hi[axis] - b.lo[axis])
+                axis = c;
+        // counts of each slice along the axis
+        vector<int> slice(32, 0);
+        for(int r = b.lo[0]; r <= b.hi[0]; r++)
+            for(int g = b.lo[1]; g <= b.hi[1]; g++)
+                for(int bl = b.lo[2]; bl <= b.hi[2]; bl++) {
+                    int v[3] = { r, g, bl };
+                    slice[v[axis]] += hist[(r << 10) | (g << 5) | bl];
+                }
+        int cut = b.lo[axis], seen = slice[cut];
+        while(cut + 1 < b.hi[axis] && seen + slice[cut + 1] <= b.count / 2)
+            seen += slice[++cut];
+        Box a = b, c = b;
+        a.hi[axis] = cut, c.lo[axis] = cut + 1;
+        shrink(a, hist), shrink(c, hist);
+        boxes[pick] = a;
+        if(c.count > 0)
+            boxes.push_back(c);
+    }
+    // palette entry = mean color of the pixels in the box
+    colors.clear();
+    for(int i = 0; i < int(boxes.size()); i++) {
+        Box& b = boxes[i];
+        double sum[3] = { 0, 0, 0 }, total = 0;
+        for(int r = b.lo[0]; r <= b.hi[0]; r++)
+            for(int g = b.lo[1]; g <= b.hi[1]; g++)
+                for(int bl = b.lo[2]; bl <= b.hi[2]; bl++) {
+                    int k = (r << 10) | (g << 5) | bl;
+                    sum[0] += sums[k * 3], sum[1] += sums[k * 3 + 1], sum[2] += sums[k * 3 + 2], total += hist[k];
+                }
+        if(total == 0)
+            total = 1;
+        colors.push_back(RGB((unsigned char)(sum[0] / total + 0.5), (unsigned char)(sum[1] / total + 0.5), (unsigned char)(sum[2] / total + 0.5)));
+    }
+    // nearest palette entry for every histogram cell that occurs
+    vector<unsigned char> nearest(1 << 15, 0);
+    for(int k = 0; k < 1 << 15; k++) {
+        if(!hist[k])
+            continue;
+        int r = ((k >> 10) & 31) * 8 + 4, g = ((k >> 5) & 31) * 8 + 4, bl = (k & 31) * 8 + 4;
+        int best = 0, dist = 1 << 30;
+        for(int i = 0; i < int(colors.size()); i++) {
+            int dr = colors[i].R - r, dg = colors[i].G - g, db = colors[i].B - bl;
+            int d = dr * dr + dg * dg + db * db;
+            if(d < dist)
+                dist = d, best = i;
+        }
+        nearest[k] = (unsigned char)best;
+    }
+    for(int y = 0; y < height; y++)
+        for(int x = 0; x < width; x++) {
+            const RGB& c = bmp.row(y)[x];
+            set(x, y, nearest[((c.R >> 3) << 10) | ((c.G >> 3) << 5) | (c.B >> 3)]);
+        }
+    return colors.size();
+}
+
+// fit box to the colors it holds
+void IndexedBitmap::shrink(Box& b, vector<int>& hist) {
+    int lo[3] = { 31, 31, 31 }, hi[3] = { 0, 0, 0 };
+    b.count = 0;
+    for(int r = b.lo[0]; r <= b.hi[0]; r++)
+        for(int g = b.lo[1]; g <= b.hi[1]; g++)
+            for(int bl = b.lo[2]; bl <= b.hi[2]; bl++) {
+                int k = hist[(r << 10) | (g << 5) | bl];
+                if(!k)
+                    continue;
+                b.count += k;
+                int v[3] = { r, g, bl };
+                for(int c = 0; c < 3; c++)
+                    lo[c] = min(lo[c], v[c]), hi[c] = max(hi[c], v[c]);
+            }
+    if(b.count)
+        for(int c = 0; c < 3; c++)
+            b.lo[c] = lo[c], b.hi[c] = hi[c];
+}
+
+// back to true color; false if bmp cannot take the size
+bool IndexedBitmap::expand(Bitmap& bmp) {
+    if((bmp.getWidth() != width || bmp.getHeight() != height) && !bmp.setSize(width, height))
+        return false;
+    vector<RGB> lut(colors);
+    lut.resize(256);
+    for(int y = 0; y < height; y++) {
+        RGB *d = bmp.row(y);
+        if(depth == 8) {
+            const unsigned char *s = row(y);
+            for(int x = 0; x < width; x++)
+                d[x] = lut[s[x]];
+        } else
+            for(int x = 0; x < width; x++)
+                d[x] = lut[get(x, y)];
+    }
+    return true;
+}
+
+// rle: RLE8, depth 8 only
+bool IndexedBitmap::save(const char *name, bool rle = false) {
+    PROFILE_SCOPE("IndexedBitmap::save");
+    rle = rle && depth == 8;
+    vector<unsigned char> body;
+    if(rle) {
+        for(int y = 0; y < height; y++)
+            encodeRLE8(y, body);
+        if(body.empty()) { // no rows, the end of bitmap alone
+            body.push_back(0);
+            body.push_back(1);
+        }
+        body[body.size() - 1] = 1; // last end of line becomes end of bitmap
+    }
+    int entries = 1 << depth;
+    BitmapHeader header;
+    bitmapHeaderInit(header, width, height);
+    header.bits_per_pixel = depth;
+    header.compression = rle ? 1 : 0;
+    header.data_offset = 54 + 4 * entries;
+    header.data_size = rle ? body.size() : data.size();
+    header.file_size = header.data_offset + header.data_size;
+    header.used_colors = entries;
+    fstream file(name, ios::out | ios::binary);
+    if(!file)
+        return false;
+    file.write((char*)&header, sizeof(header));
+    for(int i = 0; i < entries; i++) {
+        RGB c = i < int(colors.size()) ? colors[i] : RGB();
+        unsigned char quad[4] = { c.B, c.G, c.R, 0 };
+        file.write((char*)quad, 4);
+    }
+    if(rle)
+        file.write((char*)body.data(), body.size());
+    else
+        file.write((char*)data.data(), data.size());
+    file.close();
+    if(file.fail())
+        return false;
+    PROFILE_COUNT(BYTES_WRITTEN, header.file_size);
+    return true;
+}
+
+// runs of one index as (count, index), stretches without repeats in
+// absolute mode, then end of line
+void IndexedBitmap::encodeRLE8(int y, vector<unsigned char>& out) {
+    const unsigned char *s = row(y);
+    int x = 0;
+    while(x < width) {
+        int run = 1;
+        while(x + run < width && run < 255 && s[x + run] == s[x])
+            run++;
+        if(run > 1) {
+            out.push_back((unsigned char)run), out.push_back(s[x]);
+            x += run;
+            continue;
+        }
+        // literal stretch, until the next repeat
+        int n = 1;
+        while(x + n < width && n < 255 && (x + n + 1 >= width || s[x + n] != s[x + n + 1]))
+            n++;
+        if(n < 3) {
+            for(int i = 0; i < n; i++)
+                out.push_back(1), out.push_back(s[x + i]);
+        } else {
+            out.push_back(0), out.push_back((unsigned char)n);
+            out.insert(out.end(), s + x, s + x + n);
+            if(n & 1)
+                out.push_back(0);
+        }
+        x += n;
+    }
+    out.push_back(0), out.push_back(0);
+}
+
+bool IndexedBitmap::load(const char *name) {
+    PROFILE_SCOPE("IndexedBitmap::load");
+    fstream file(name, ios::in | ios::binary);
+    if(!file)
+        return false;
+    BitmapHeader h;
+    file.read((char*)&h, sizeof(h));
+    if(!file || h.identity[0] != 'B' || h.identity[1] != 'M' || h.height < 0)
+        return false;
+    if(h.compression != 0 && !(h.compression == 1 && h.bits_per_pixel == 8))
+        return false;
+    if(!setSize(h.width, h.height, h.bits_per_pixel))
+        return false;
+    int entries = h.used_colors ? h.used_colors : 1 << depth;
+    if(entries > 1 << depth)
+        return false;
+    file.seekg(14 + h.info_size);
+    colors.resize(entries);
+    for(int i = 0; i < entries; i++) {
+        unsigned char quad[4];
+        file.read((char*)quad, 4);
+        colors[i] = RGB(quad[2], quad[1], quad[0]);
+    }
+    file.seekg(h.data_offset);
+    if(h.compression == 0) {
+        file.read((char*)data.data(), data.size());
+        return bool(file);
+    }
+    vector<unsigned char> body((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    size_t i = 0;
+    int x = 0, y = 0;
+    while(i + 1 < body.size() && y < height) {
+        int a = body[i], b = body[i + 1];
+        i += 2;
+        if(a > 0) {
+            for(int k = 0; k < a; k++)
+                set(x++, y, b);
+        } else if(b == 0)
+            x = 0, y++;
+        else if(b == 1)
+            break;
+        else if(b == 2) {
+            if(i + 1 >= body.size())
+                break;
+            x += body[i], y += body[i + 1];
+            i += 2;
+        } else {
+            for(int k = 0; k < b && i < body.size(); k++)
+                set(x++, y, body[i++]);
+            i += b & 1;
+        }
+    }
+    return true;
+}
+
+
+#endif /* __INDEXED_H__ */
@@ -0,0 +1,230 @@
+#ifndef __LAYER_H__
+#define __LAYER_H__
+
+#include <vector>
+#include "bitmap.h"
+using namespace std;
+
+// premultiplied color: B, G, R are already scaled by A
+class RGBA {
+public:
+    unsigned char B, G, R, A;
+
+    RGBA();                             // transparent
+    RGBA(RGB color, unsigned char A);   // premultiplies color
+    RGBA(unsigned char R, unsigned char G, unsigned char B, unsigned char A);
+};
+
+enum BlendMode { OVER, ADD, MULTIPLY, SCREEN };
+
+/*
+Layer
+
+RGBA overlay composited onto a Bitmap
+coordinates work like Bitmap (origin in the middle), and the layer's
+top-left pixel lands on buffer pixel (x, y) of the base
+
+anything drawn on a Bitmap can be turned into a layer with capture():
+draw on a scratch Bitmap cleared to a key color, and every pixel that is
+not the key becomes a layer pixel
+*/
+class Layer {
+public:
+    int x, y;               // top-left on the base, buffer coordinates
+    BlendMode mode;
+    unsigned char opacity;
+
+    Layer(int width, int height);
+    ~Layer();
+    void clear();                           // fully transparent
+    void fill(RGBA color);
+    void set(P2 point, RGBA color);
+    RGBA get(P2 point);
+    void capture(Bitmap& bmp, RGB key, unsigned char alpha); // non-key pixels of bmp
+    int getWidth();
+    int getHeight();
+    RGBA *getBuffer();
+private:
+    int width, height;
+    P2 origin;
+    RGBA *buffer;
+    Layer(const Layer&);
+    Layer& operator=(const Layer&);
+};
+
+void composite(Bitmap& base, Layer& layer);             // blend one layer
+void flatten(Bitmap& base, vector<Layer*>& layers);     // blend all layers, bottom first, in one pass
+
+
+/******************************************************************************/
+//  RGBA Member Functions
+/******************************************************************************/
+
+// x / 255 rounded, exact for x <= 255 * 255
+inline int div255(int x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// transparent
+RGBA::RGBA() {
+    B = G = R = A = 0;
+}
+
+// premultiplies color
+RGBA::RGBA(RGB color, unsigned char A) {
+    this->B = (unsigned char)div255(color.B * A);
+    this->G = (unsigned char)div255(color.G * A);
+    this->R = (unsigned char)div255(color.R * A);
+    this->A = A;
+}
+
+RGBA::RGBA(unsigned char R, unsigned char G, unsigned char B, unsigned char A) {
+    *this = RGBA(RGB(R, G, B), A);
+}
+
+
+/******************************************************************************/
+//  Layer Member Functions
+/******************************************************************************/
+
+Layer::Layer(int width, int height) {
+    this->width = width, this->height = height;
+    x = y = 0;
+    mode = OVER;
+    opacity = 255;
+    origin = P2(width / 2 - 1, height / 2 - 1);
+    buffer = new RGBA[width * height];
+}
+
+Layer::~Layer() {
+    delete [] buffer;
+}
+
+// fully transparent
+void Layer::clear() {
+    fill(RGBA());
+}
+
+void Layer::fill(RGBA color) {
+    for(int i = 0; i < width * height; i++)
+        buffer[i] = color;
+}
+
+void Layer::set(P2 point, RGBA color) {
+    P2 temp = origin + point;
+    int x = int(temp.x), y = int(temp.y);
+    if(x < width && x >= 0 && y < height && y >= 0)
+        buffer[y * width + x] = color;
+}
+
+RGBA Layer::get(P2 point) {
+    P2 temp = origin + point;
+    int x = int(temp.x), y = int(temp.y);
+    if(x < width && x >= 0 && y < height && y >= 0)
+        return buffer[y * width + x];
+    return RGBA();
+}
+
+// non-key pixels of bmp
+void Layer::capture(Bitmap& bmp, RGB key, unsigned char alpha = 255) {
+    int w = bmp.getWidth() < width ? bmp.getWidth() : width;
+    int h = bmp.getHeight() < height ? bmp.getHeight() : height;
+    for(int j = 0; j < h; j++)
+        for(int i = 0; i < w; i++) {
+            RGB c = bmp.row(j)[i];
+            if(c.R != key.R || c.G != key.G || c.B != key.B)
+                buffer[j * width + i] = RGBA(c, alpha);
+        }
+}
+
+int Layer::getWidth() {
+    return width;
+}
+
+int Layer::getHeight() {
+    return height;
+}
+
+RGBA *Layer::getBuffer() {
+    return buffer;
+}
+
+
+/******************************************************************************/
+//  Compositing
+/******************************************************************************/
+
+// blend n layer pixels onto n base pixels; below full opacity the row is
+// scaled into faded, which holds at least n pixels and belongs to the caller
+void blendRow(unsigned char *d, const RGBA *s, int n, BlendMode mode, int opacity, RGBA *faded) {
+    const unsigned char *p = (const unsigned char*)s;
+    if(opacity != 255) {
+        unsigned char *f = (unsigned char*)faded;
+        for(int i = 0; i < n * 4; i++)
+            f[i] = (unsigned char)div255(p[i] * opacity);
+        p = f;
+    }
+    switch(mode) {
+        case ADD:
+            for(int i = 0; i < n; i++)
+                for(int k = 0; k < 3; k++) {
+                    int v = d[i * 3 + k] + p[i * 4 + k];
+                    d[i * 3 + k] = (unsigned char)(v > 255 ? 255 : v);
+                }
+            break;
+        case MULTIPLY:
+            for(int i = 0; i < n; i++)
+                for(int k = 0; k < 3; k++) {
+                    int c = d[i * 3 + k];
+                    d[i * 3 + k] = (unsigned char)(div255(p[i * 4 + k] * c) + div255(c * (255 - p[i * 4 + 3])));
+                }
+            break;
+        case SCREEN:
+            for(int i = 0; i < n; i++)
+                for(int k = 0; k < 3; k++) {
+                    int c = d[i * 3 + k];
+                    d[i * 3 + k] = (unsigned char)(p[i * 4 + k] + c - div255(p[i * 4 + k] * c));
+                }
+            break;
+        default:
+            for(int i = 0; i < n; i++)
+                for(int k = 0; k < 3; k++) {
+                    int v = p[i * 4 + k] + div255(d[i * 3 + k] * (255 - p[i * 4 + 3]));
+                    d[i * 3 + k] = (unsigned char)(v > 255 ? 255 : v);
+                }
+            break;
+    }
+}
+
+// blend one layer
+void composite(Bitmap& base, Layer& layer) {
+    vector<Layer*> layers(1, &layer);
+    flatten(base, layers);
+}
+
+// blend all layers, bottom first, in one pass
+void flatten(Bitmap& base, vector<Layer*>& layers) {
+    int W = base.getWidth(), H = base.getHeight();
+    int widest = 0;
+    for(int i = 0; i < int(layers.size()); i++)
+        if(layers[i]->opacity != 255 && layers[i]->getWidth() > widest)
+            widest = layers[i]->getWidth();
+    vector<RGBA> faded(widest);
+    for(int y = 0; y < H; y++) {
+        unsigned char *row = (unsigned char*)base.row(y);
+        for(int i = 0; i < int(layers.size()); i++) {
+            Layer& l = *layers[i];
+            int ly = y - l.y;
+            if(ly < 0 || ly >= l.getHeight())
+                continue;
+            int x0 = l.x < 0 ? 0 : l.x, x1 = l.x + l.getWidth() > W ? W : l.x + l.getWidth();
+            if(x0 >= x1)
+                continue;
+            blendRow(row + x0 * 3, l.getBuffer() + ly * l.getWidth() + x0 - l.x, x1 - x0, l.mode, l.opacity, faded.data());
+        }
+    }
+}
+
+
+#endif /* __LAYER_H__ */
@@ -0,0 +1,190 @@
+#ifndef __LUT_H__
+#define __LUT_H__
+
+#include <cmath>
+#include "bitmap.h"
+using namespace std;
+
+enum { CH_B = 1, CH_G = 2, CH_R = 4, CH_RGB = 7 };
+
+/*
+ColorLUT
+
+chain of per-channel curves folded into three 256-entry tables
+every call maps the current output through one more curve, so
+
+    ColorLUT lut; lut.levels(16, 235, 0, 255).gamma(2.2).contrast(1.2);
+
+costs one lookup per byte however long the chain is.
+swap() reorders channels; it is folded in as well (`src` says which
+input channel feeds each output channel).
+*/
+class ColorLUT {
+public:
+    unsigned char B[256], G[256], R[256];
+    int src[3];         // input channel of output B, G, R
+
+    ColorLUT();         // identity
+    ColorLUT& brightness(int d, int ch);
+    ColorLUT& contrast(double k, int ch);           // around 128
+    ColorLUT& gamma(double g, int ch);              // out = 255 * (in / 255) ^ (1 / g)
+    ColorLUT& levels(int inLo, int inHi, int outLo, int outHi, int ch);
+    ColorLUT& invert(int ch);
+    ColorLUT& curve(const unsigned char *table, int ch);    // any 256-entry curve
+    ColorLUT& swap(const char *order);              // e.g. "BGR": R <- B, G <- G, B <- R
+    ColorLUT& then(ColorLUT& next);                 // append another chain
+    void apply(RGB *p, int n);
+    void apply(Bitmap& bmp);
+private:
+    unsigned char *table(int i);
+    ColorLUT& map(const unsigned char *f, int ch);  // table = f(table)
+};
+
+void grayscale(RGB *p, int n);  // RGB::avg() on n pixels
+void grayscale(Bitmap& bmp);
+
+
+ColorLUT::ColorLUT() {
+    for(int i = 0; i < 256; i++)
+        B[i] = G[i] = R[i] = (unsigned char)i;
+    src[0] = 0, src[1] = 1, src[2] = 2;
+}
+
+ColorLUT& ColorLUT::brightness(int d, int ch = CH_RGB) {
+    unsigned char f[256];
+    for(int i = 0; i < 256; i++)
+        f[i] = (unsigned char)(i + d < 0 ? 0 : (i + d > 255 ? 255 : i + d));
+    return map(f, ch);
+}
+
+// around 128
+ColorLUT& ColorLUT::contrast(double k, int ch = CH_RGB) {
+    unsigned char f[256];
+    for(int i = 0; i < 256; i++) {
+        int v = int(floor((i - 128) * k + 128.5));
+        f[i] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+    return map(f, ch);
+}
+
+// out = 255 * (in / 255) ^ (1 / g)
+ColorLUT& ColorLUT::gamma(double g, int ch = CH_RGB) {
+    unsigned char f[256];
+    for(int i = 0; i < 256; i++)
+        f[i] = (unsigned char)floor(255 * pow(i / 255.0, 1 / g) + 0.5);
+    return map(f, ch);
+}
+
+ColorLUT& ColorLUT::levels(int inLo, int inHi, int outLo, int outHi, int ch = CH_RGB) {
+    unsigned char f[256];
+    for(int i = 0; i < 256; i++) {
+        int v = i <= inLo ? outLo : (i >= inHi ? outHi :
+            outLo + ((i - inLo) * (outHi - outLo) + (inHi - inLo) / 2) / (inHi - inLo));
+        f[i] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+    return map(f, ch);
+}
+
+ColorLUT& ColorLUT::invert(int ch = CH_RGB) {
+    unsigned char f[256];
+    for(int i = 0; i < 256; i++)
+        f[i] = (unsigned char)(255 - i);
+    return map(f, ch);
+}
+
+// any 256-entry curve
+ColorLUT& ColorLUT::curve(const unsigned char *table, int ch = CH_RGB) {
+    return map(table, ch);
+}
+
+// e.g. "BGR": R <- B, G <- G, B <- R
+ColorLUT& ColorLUT::swap(const char *order) {
+    unsigned char t[3][256];
+    int s[3];
+    for(int i = 0; i < 3; i++) {
+        char c = order[2 - i]; // order is written R G B, tables are stored B G R
+        int from = c == 'B' ? 0 : (c == 'G' ? 1 : 2);
+        for(int v = 0; v < 256; v++)
+            t[i][v] = table(from)[v];
+        s[i] = src[from];
+    }
+    for(int i = 0; i < 3; i++) {
+        for(int v = 0; v < 256; v++)
+            table(i)[v] = t[i][v];
+        src[i] = s[i];
+    }
+    return *this;
+}
+
+// append another chain
+ColorLUT& ColorLUT::then(ColorLUT& next) {
+    unsigned char t[3][256];
+    int s[3];
+    for(int i = 0; i < 3; i++) {
+        int from = next.src[i];
+        for(int v = 0; v < 256; v++)
+            t[i][v] = next.table(i)[table(from)[v]];
+        s[i] = src[from];
+    }
+    for(int i = 0; i < 3; i++) {
+        for(int v = 0; v < 256; v++)
+            table(i)[v] = t[i][v];
+        src[i] = s[i];
+    }
+    return *this;
+}
+
+void ColorLUT::apply(RGB *p, int n) {
+    unsigned char *d = (unsigned char*)p;
+    if(src[0] == 0 && src[1] == 1 && src[2] == 2) {
+        for(int i = 0; i < n; i++) {
+            d[i * 3] = B[d[i * 3]];
+            d[i * 3 + 1] = G[d[i * 3 + 1]];
+            d[i * 3 + 2] = R[d[i * 3 + 2]];
+        }
+        return;
+    }
+    for(int i = 0; i < n; i++) {
+        unsigned char c[3] = { d[i * 3], d[i * 3 + 1], d[i * 3 + 2] };
+        d[i * 3] = B[c[src[0]]];
+        d[i * 3 + 1] = G[c[src[1]]];
+        d[i * 3 + 2] = R[c[src[2]]];
+    }
+}
+
+void ColorLUT::apply(Bitmap& bmp) {
+    for(int y = 0; y < bmp.getHeight(); y++)
+        apply(bmp.row(y), bmp.getWidth());
+}
+
+unsigned char *ColorLUT::table(int i) {
+    return i == 0 ? B : (i == 1 ? G : R);
+}
+
+// table = f(table)
+ColorLUT& ColorLUT::map(const unsigned char *f, int ch) {
+    for(int i = 0; i < 3; i++)
+        if(ch & (1 << i))
+            for(int v = 0; v < 256; v++)
+                table(i)[v] = f[table(i)[v]];
+    return *this;
+}
+
+
+// RGB::avg() on n pixels
+void grayscale(RGB *p, int n) {
+    unsigned char *d = (unsigned char*)p;
+    for(int i = 0; i < n; i++) {
+        // (s * 43691) >> 17 == s / 3 for every s <= 765
+        unsigned char a = (unsigned char)(((d[i * 3] + d[i * 3 + 1] + d[i * 3 + 2]) * 43691) >> 17);
+        d[i * 3] = d[i * 3 + 1] = d[i * 3 + 2] = a;
+    }
+}
+
+void grayscale(Bitmap& bmp) {
+    for(int y = 0; y < bmp.getHeight(); y++)
+        grayscale(bmp.row(y), bmp.getWidth());
+}
+
+
+#endif /* __LUT_H__ */
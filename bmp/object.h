@@ -1,9 +1,13 @@
 #ifndef __OBJECT_H__
-#define __OBJECT_H
+#define __OBJECT_H__
 
 #include "point.h"
+#include "profile.h"
+#include "arena.h"
 #include <fstream>
 #include <vector>
+#include <thread>
+#include <algorithm>
 using namespace std;
 
 class BezObj {
@@ -20,10 +24,16 @@ public:
     void rotateY(double theta); // Y axis centered rotate
     void rotateZ(double theta); // Z axis centered rotate
     void split(); // bezier split
-    void split(int n); // bezier split n times
+    void split(int n, int threads); // bezier split n times, patches shared out over threads
+    template<class T>
+    void tessellate(int n, ArenaVector< Point3<T> >& out, int threads);   // split n times into flat bicubic patches, P3, P3f or P3q
 private:
-    void splitA();
-    void splitB();
+    struct Patch {
+        P3 p[4][4];
+    };
+    template<class Store> void subdivide(int n, int threads, Store& store);
+    template<class Store> static void splitPatch(const Patch& patch, int n, size_t at, size_t stride, Store& store);
+    static void halve(const Patch& temp, Patch& addA, Patch& addB, bool columns);
 };
 
 class LinObj {
@@ -161,59 +171,110 @@ void BezObj::rotateZ(double theta) {
 
 // bezier split
 void BezObj::split() {
-    splitA(); splitB();
+    split(1, 0);
 }
 
-// bezier split n times
-void BezObj::split(int n) {
-    if(n > 0 && n < 7) {
-        splitA(); splitB();
-        split(n - 1);
-    }
-}
-
-void BezObj::splitA() {
-    int dataSize = data.size();
-    for(int i = 0; i < dataSize; i++) {
-        vector< vector<P3> > &temp = data[i];
-        vector< vector<P3> > addA, addB;
-        for(int j = 0; j < 4; j++) {
-            vector<P3> partA, partB;
-            P3 midA = (temp[j][0] + temp[j][1]) / 2;
-            P3 midB = (temp[j][1] + temp[j][2]) / 2;
-            P3 midC = (temp[j][2] + temp[j][3]) / 2;
-            P3 midD = (midA + midB) / 2;
-            P3 midE = (midB + midC) / 2;
-            P3 midF = (midD + midE) / 2;
-            partA.push_back(temp[j][0]); partA.push_back(midA); partA.push_back(midD); partA.push_back(midF);
-            partB.push_back(midF); partB.push_back(midE); partB.push_back(midC); partB.push_back(temp[j][3]);
-            addA.push_back(partA); addB.push_back(partB);
+// bezier split n times, patches shared out over threads (0: one per hardware thread)
+void BezObj::split(int n, int threads = 0) {
+    if(n <= 0 || n >= 7 || data.empty())
+        return;
+    PROFILE_SCOPE("BezObj::split");
+    vector< vector< vector<P3> > > out(data.size() << (2 * n));
+    auto store = [&out](size_t at, const Patch& patch) {
+        vector< vector<P3> > &rows = out[at];
+        rows.resize(4);
+        for(int j = 0; j < 4; j++)
+            rows[j].assign(patch.p[j], patch.p[j] + 4);
+    };
+    subdivide(n, threads, store);
+    data.swap(out);
+}
+
+// split n times into flat bicubic patches: 16 control points each, row
+// by row, appended to out in the order of split(n); the splitting is in
+// double and P3 patches are equal to split(n), P3f and P3q ones are
+// rounded. The only allocation is out's, so with an arena behind it a
+// frame can tessellate afresh without touching malloc
+template<class T>
+void BezObj::tessellate(int n, ArenaVector< Point3<T> >& out, int threads) {
+    if(n < 0 || n >= 7 || data.empty())
+        return;
+    PROFILE_SCOPE("BezObj::tessellate");
+    size_t first = out.size();
+    out.resize(first + (data.size() << (2 * n)) * 16);
+    Point3<T> *points = out.data() + first;
+    auto store = [points](size_t at, const Patch& patch) {
+        for(int m = 0; m < 16; m++)
+            points[16 * at + m] = Point3<T>(patch.p[m / 4][m % 4]);
+    };
+    subdivide(n, threads, store);
+}
+
+// one split puts the halves of patch i at i, i + N, i + 2N and i + 3N
+// of the N patches before it, so the descendants of patch i after n
+// splits are at i + N * m, m < 4^n; every patch is split on its own, on
+// the stack, and store(at, piece) puts each piece in a result sized up
+// front, in the same order as splitting all of them level by level, with
+// the same arithmetic
+template<class Store>
+void BezObj::subdivide(int n, int threads, Store& store) {
+    size_t count = data.size();
+    if(threads <= 0)
+        threads = max(int(thread::hardware_concurrency()), 1);
+    threads = int(min(size_t(threads), max((count << (2 * n)) / 4096, size_t(1))));
+    auto part = [&](int t) {
+        for(size_t i = count * t / threads; i < count * (t + 1) / threads; i++) {
+            Patch patch;
+            for(int j = 0; j < 4; j++)
+                for(int k = 0; k < 4; k++)
+                    patch.p[j][k] = data[i][j][k];
+            splitPatch(patch, n, i, count, store);
         }
-        data[i] = addA; data.push_back(addB);
+    };
+    vector<thread> workers;
+    for(int t = 1; t < threads; t++)
+        workers.push_back(thread(part, t));
+    part(0);
+    for(int t = 0; t < int(workers.size()); t++)
+        workers[t].join();
+}
+
+// n more splits of one patch, its pieces from `at` on, `stride` apart
+template<class Store>
+void BezObj::splitPatch(const Patch& patch, int n, size_t at, size_t stride, Store& store) {
+    if(n == 0) {
+        store(at, patch);
+        return;
     }
-}
-void BezObj::splitB() {
-    int dataSize = data.size();
-    for(int i = 0; i < dataSize; i++) {
-        vector< vector<P3> > &temp = data[i];
-        vector< vector<P3> > addA, addB;
-        for(int j = 0; j < 4; j++) {
-            vector<P3> partA, partB;
-            P3 midA = (temp[0][j] + temp[1][j]) / 2;
-            P3 midB = (temp[1][j] + temp[2][j]) / 2;
-            P3 midC = (temp[2][j] + temp[3][j]) / 2;
-            P3 midD = (midA + midB) / 2;
-            P3 midE = (midB + midC) / 2;
-            P3 midF = (midD + midE) / 2;
-            partA.push_back(temp[0][j]); partA.push_back(midA); partA.push_back(midD); partA.push_back(midF);
-            partB.push_back(midF); partB.push_back(midE); partB.push_back(midC); partB.push_back(temp[3][j]);
-            addA.push_back(partA); addB.push_back(partB);
-        }
-        data[i] = addA; data.push_back(addB);
+    Patch a, b, aa, ab, ba, bb;
+    halve(patch, a, b, false);
+    halve(a, aa, ab, true);
+    halve(b, ba, bb, true);
+    splitPatch(aa, n - 1, at, stride * 4, store);
+    splitPatch(ba, n - 1, at + stride, stride * 4, store);
+    splitPatch(ab, n - 1, at + 2 * stride, stride * 4, store);
+    splitPatch(bb, n - 1, at + 3 * stride, stride * 4, store);
+}
+
+// de Casteljau at 1/2 along every row, or along every column, whose
+// halves then come out transposed
+void BezObj::halve(const Patch& temp, Patch& addA, Patch& addB, bool columns) {
+    for(int j = 0; j < 4; j++) {
+        P3 a0 = columns ? temp.p[0][j] : temp.p[j][0];
+        P3 a1 = columns ? temp.p[1][j] : temp.p[j][1];
+        P3 a2 = columns ? temp.p[2][j] : temp.p[j][2];
+        P3 a3 = columns ? temp.p[3][j] : temp.p[j][3];
+        P3 midA = (a0 + a1) / 2;
+        P3 midB = (a1 + a2) / 2;
+        P3 midC = (a2 + a3) / 2;
+        P3 midD = (midA + midB) / 2;
+        P3 midE = (midB + midC) / 2;
+        P3 midF = (midD + midE) / 2;
+        addA.p[j][0] = a0; addA.p[j][1] = midA; addA.p[j][2] = midD; addA.p[j][3] = midF;
+        addB.p[j][0] = midF; addB.p[j][1] = midE; addB.p[j][2] = midC; addB.p[j][3] = a3;
     }
 }
 
-
 /******************************************************************************/
 //  LinObj Member Functions
 /******************************************************************************/
@@ -0,0 +1,328 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <vector>
+#include "bitmap.h"
+#include "convolution.h"
+#include "lut.h"
+#include "processor.h"
+#include "scratch.h"
+using namespace std;
+
+/*
+Pipeline
+
+queue of filters run fused, one tile at a time
+
+every tile is read once with the halo all stages need together, then
+each stage shrinks the block by its own halo, ping-ponging between two
+tile-sized scratch buffers (intermediates stay in cache). Results for a
+row of tiles go to a band buffer which is written back once the whole row
+is done; the original rows the next tile row still reads as halo are kept
+in a small ring. Output is identical to running the same filters one by
+one with ImageProcessor over the same range.
+
+    |<- halo ->|<-  tile  ->|<- halo ->|
+    +--------------------------------------+   input block (slot 0)
+    |   +------------------------------+   |   after stage 1
+    |   |   +----------------------+   |   |   ...
+    |   |   |      tile output     |   |   |   band
+*/
+
+// where a block sits in the image
+struct TileInfo {
+    int x, y;               // buffer coordinates of the block's first pixel
+    int width, height;      // image size
+    ScratchPool *pool;
+    int slot;               // first pool slot free for the stage
+};
+
+class Stage {
+public:
+    virtual ~Stage() {}
+    virtual int halo() = 0; // pixels needed around every output pixel
+    // `in` is padded by halo() on every side, `out` is w x h
+    virtual void run(const RGB *in, int istride, RGB *out, int ostride, int w, int h, TileInfo& info) = 0;
+};
+
+class BlurStage : public Stage {
+public:
+    BlurStage(int r);
+    int halo();
+    void run(const RGB *in, int istride, RGB *out, int ostride, int w, int h, TileInfo& info);
+private:
+    int r;
+};
+
+class ConvolveStage : public Stage {
+public:
+    ConvolveStage(Kernel k, bool separable);
+    int halo();
+    void run(const RGB *in, int istride, RGB *out, int ostride, int w, int h, TileInfo& info);
+private:
+    Kernel kernel;
+    Convolver conv;
+};
+
+class LUTStage : public Stage {
+public:
+    LUTStage(ColorLUT& lut, bool gray);
+    int halo();
+    void run(const RGB *in, int istride, RGB *out, int ostride, int w, int h, TileInfo& info);
+private:
+    ColorLUT lut;
+    bool gray;
+};
+
+class Pipeline {
+public:
+    Pipeline(Bitmap *bmp);
+    ~Pipeline();
+    void rerange();
+    void rerange(P2P);
+    void rerange(P2, P2);
+    void setTile(int size);
+    Pipeline& add(Stage *stage);    // queue a stage, the pipeline deletes it
+    Pipeline& blur(int r);          // ImageProcessor::GaussianBlur
+    Pipeline& convolve(Kernel k, bool separable);
+    Pipeline& sharpen();
+    Pipeline& emboss();
+    Pipeline& lut(ColorLUT& lut);
+    Pipeline& grayscale();
+    void clear();                   // drop all stages
+    bool run();
+private:
+    Bitmap *bmp;
+    vector<Stage*> stages;
+    ScratchPool pool;
+    int tile;
+    int _r, _l, _d, _u;
+    enum { IN, PING, PONG, BAND, RING, STAGE };
+    void fetch(RGB *block, int bx, int by, int bw, int bh, int x0, int y0, int x1, int ty0, int halo, RGB *ring);
+    void fixup(RGB *block, const RGB *in, int istride, int bx, int by, int bw, int bh, int x0, int y0, int x1, int y1);
+};
+
+
+/******************************************************************************/
+//  Stages
+/******************************************************************************/
+
+BlurStage::BlurStage(int r) {
+    this->r = r;
+}
+
+int BlurStage::halo() {
+    return r;
+}
+
+void BlurStage::run(const RGB *in, int istride, RGB *out, int ostride, int w, int h, TileInfo& info) {
+    diskBlur(in + r * istride + r, istride, out, ostride, w, h, r,
+        -info.x, -info.y, info.width - info.x, info.height - info.y, *info.pool, info.slot);
+}
+
+ConvolveStage::ConvolveStage(Kernel k, bool separable = true) : kernel(k), conv(kernel, separable) {}
+
+int ConvolveStage::halo() {
+    return conv.rx > conv.ry ? conv.rx : conv.ry;
+}
+
+void ConvolveStage::run(const RGB *in, int istride, RGB *out, int ostride, int w, int h, TileInfo&) {
+    int e = halo();
+    for(int y = 0; y < h; y++)
+        conv.row(in + (y + e) * istride + e, istride, w, out + y * ostride);
+}
+
+// gray: RGB::avg() before the tables
+LUTStage::LUTStage(ColorLUT& lut, bool gray = false) : lut(lut) {
+    this->gray = gray;
+}
+
+int LUTStage::halo() {
+    return 0;
+}
+
+void LUTStage::run(const RGB *in, int istride, RGB *out, int ostride, int w, int h, TileInfo&) {
+    for(int y = 0; y < h; y++) {
+        RGB *row = out + y * ostride;
+        for(int x = 0; x < w; x++)
+            row[x] = in[y * istride + x];
+        if(gray)
+            ::grayscale(row, w);
+        lut.apply(row, w);
+    }
+}
+
+
+/******************************************************************************/
+//  Pipeline Member Functions
+/******************************************************************************/
+
+Pipeline::Pipeline(Bitmap *bmp) {
+    this->bmp = bmp;
+    tile = 64;
+    rerange();
+}
+
+Pipeline::~Pipeline() {
+    clear();
+}
+
+void Pipeline::rerange() {
+    rerange(P2P(
+        P2(-bmp->getOrigin().x, -bmp->getOrigin().y),
+        P2(bmp->getWidth() - bmp->getOrigin().x, bmp->getHeight() - bmp->getOrigin().y)
+    ));
+}
+
+void Pipeline::rerange(P2 p1, P2 p2) {
+    rerange(P2P(p1, p2));
+}
+
+void Pipeline::rerange(P2P p2p) {
+    if(p2p.p1.x >= p2p.p2.x)
+        _r = int(p2p.p1.x), _l = int(p2p.p2.x);
+    else
+        _l = int(p2p.p1.x), _r = int(p2p.p2.x);
+    if(p2p.p1.y >= p2p.p2.y)
+        _u = int(p2p.p1.y), _d = int(p2p.p2.y);
+    else
+        _d = int(p2p.p1.y), _u = int(p2p.p2.y);
+}
+
+void Pipeline::setTile(int size) {
+    tile = size > 8 ? size : 8;
+}
+
+// queue a stage, the pipeline deletes it
+Pipeline& Pipeline::add(Stage *stage) {
+    stages.push_back(stage);
+    return *this;
+}
+
+Pipeline& Pipeline::blur(int r = 1) {
+    return add(new BlurStage(r));
+}
+
+Pipeline& Pipeline::convolve(Kernel k, bool separable = true) {
+    return add(new ConvolveStage(k, separable));
+}
+
+Pipeline& Pipeline::sharpen() {
+    return convolve(Kernel::sharpen());
+}
+
+Pipeline& Pipeline::emboss() {
+    return convolve(Kernel::emboss());
+}
+
+Pipeline& Pipeline::lut(ColorLUT& lut) {
+    return add(new LUTStage(lut));
+}
+
+Pipeline& Pipeline::grayscale() {
+    ColorLUT identity;
+    return add(new LUTStage(identity, true));
+}
+
+// drop all stages
+void Pipeline::clear() {
+    for(int i = 0; i < int(stages.size()); i++)
+        delete stages[i];
+    stages.clear();
+}
+
+bool Pipeline::run() {
+    int ox = int(bmp->getOrigin().x), oy = int(bmp->getOrigin().y);
+    int W = bmp->getWidth(), H = bmp->getHeight();
+    int x0 = _l + ox < 0 ? 0 : _l + ox, y0 = _d + oy < 0 ? 0 : _d + oy;
+    int x1 = _r + ox > W ? W : _r + ox, y1 = _u + oy > H ? H : _u + oy;
+    if(x0 >= x1 || y0 >= y1 || stages.empty())
+        return false;
+    int halo = 0;
+    for(int i = 0; i < int(stages.size()); i++)
+        halo += stages[i]->halo();
+    int rw = x1 - x0, side = tile + 2 * halo;
+    RGB *in = pool.get<RGB>(IN, side * side);
+    RGB *ping = pool.get<RGB>(PING, side * side);
+    RGB *pong = pool.get<RGB>(PONG, side * side);
+    RGB *band = pool.get<RGB>(BAND, tile * rw);
+    RGB *ring = halo ? pool.get<RGB>(RING, halo * rw) : NULL;
+    RGB *buffer = bmp->getBuffer();
+    int S = bmp->getStride();
+    TileInfo info;
+    info.width = W, info.height = H, info.pool = &pool, info.slot = STAGE;
+    for(int ty = y0; ty < y1; ty += tile) {
+        int th = y1 - ty < tile ? y1 - ty : tile;
+        for(int tx = x0; tx < x1; tx += tile) {
+            int tw = x1 - tx < tile ? x1 - tx : tile;
+            int bw = tw + 2 * halo, bh = th + 2 * halo, e = halo;
+            fetch(in, tx - halo, ty - halo, bw, bh, x0, y0, x1, ty, halo, ring);
+            const RGB *src = in;
+            int sstride = bw;
+            for(int s = 0; s < int(stages.size()); s++) {
+                int h = stages[s]->halo();
+                e -= h;
+                RGB *dst = src == ping ? pong : ping;
+                int dw = tw + 2 * e, dh = th + 2 * e;
+                info.x = tx - e, info.y = ty - e;
+                stages[s]->run(src, sstride, dst, dw, dw, dh, info);
+                if(e > 0)
+                    fixup(dst, in + (halo - e) * bw + (halo - e), bw, tx - e, ty - e, dw, dh, x0, y0, x1, y1);
+                src = dst, sstride = dw;
+            }
+            for(int y = 0; y < th; y++)
+                for(int x = 0; x < tw; x++)
+                    band[y * rw + tx - x0 + x] = src[y * sstride + x];
+        }
+        // keep the originals the next tile row reads as halo, then write back
+        for(int y = ty + th - halo > ty ? ty + th - halo : ty; y < ty + th; y++)
+            for(int x = x0; x < x1; x++)
+                ring[(y % halo) * rw + x - x0] = buffer[y * S + x];
+        for(int y = 0; y < th; y++)
+            for(int x = 0; x < rw; x++)
+                buffer[(ty + y) * S + x0 + x] = band[y * rw + x];
+    }
+    return true;
+}
+
+// copy the original pixels of a block, clamped at the image border
+void Pipeline::fetch(RGB *block, int bx, int by, int bw, int bh, int x0, int y0, int x1, int ty0, int halo, RGB *ring) {
+    int W = bmp->getWidth(), H = bmp->getHeight(), S = bmp->getStride();
+    RGB *buffer = bmp->getBuffer();
+    for(int j = 0; j < bh; j++) {
+        int y = by + j;
+        y = y < 0 ? 0 : (y >= H ? H - 1 : y);
+        bool written = y >= y0 && y < ty0; // already replaced by an earlier tile row
+        for(int i = 0; i < bw; i++) {
+            int x = bx + i;
+            x = x < 0 ? 0 : (x >= W ? W - 1 : x);
+            if(written && x >= x0 && x < x1)
+                block[j * bw + i] = ring[(y % halo) * (x1 - x0) + x - x0];
+            else
+                block[j * bw + i] = buffer[y * S + x];
+        }
+    }
+}
+
+// make an intermediate block look like the full-frame result the next
+// stage would read: outside the range it holds the original pixels and
+// outside the image it repeats the nearest border pixel
+void Pipeline::fixup(RGB *block, const RGB *in, int istride, int bx, int by, int bw, int bh, int x0, int y0, int x1, int y1) {
+    int W = bmp->getWidth(), H = bmp->getHeight();
+    if(bx >= x0 && by >= y0 && bx + bw <= x1 && by + bh <= y1)
+        return;
+    for(int j = 0; j < bh; j++) {
+        int y = by + j, cy = y < 0 ? 0 : (y >= H ? H - 1 : y);
+        for(int i = 0; i < bw; i++) {
+            int x = bx + i, cx = x < 0 ? 0 : (x >= W ? W - 1 : x);
+            bool inside = cx >= x0 && cx < x1 && cy >= y0 && cy < y1;
+            if(!inside)
+                block[j * bw + i] = in[j * istride + i];
+            else if(cx != x || cy != y)
+                block[j * bw + i] = block[(cy - by) * bw + cx - bx];
+        }
+    }
+}
+
+
+#endif /* __PIPELINE_H__ */
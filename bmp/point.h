@@ -2,108 +2,142 @@
 #define __POINT_H__
 
 #include <cmath>
+#include "fixed.h"
 
+/*
+points, pairs and triangles, templated on the scalar
+
+    P2 P3 P2P P3P P2T P3T   double, what everything takes by default
+    P2f P3f                 float
+    P2q P3q                 Fixed, 16.16 fixed point
 
-class P3 {
+lengths, products and rotations are computed in T; what needs a square
+root or a sine goes through double and back. Between precisions points
+convert explicitly, P2f(p).
+*/
+template<class T>
+class Point3 {
 public:
-    double x, y, z;
-
-    P3() {}
-    P3(int x, int y, int z);
-    P3(double x, double y, double z);
-    double len();               // length
-    double len2();              // length square
-    P3 unit();                  // unit vector
-    double operator*(P3 point); // dot product
-    double dot(P3 p);           // dot product
-    P3 operator%(P3 point);     // cross product, % looks like X
-    P3 cross(P3 p);             // cross product
-    P3 operator+(P3 point);     // sum
-    P3 operator+=(P3 point);    // sum
-    P3 operator-();             // negative
-    P3 operator-(P3 point);     // difference
-    P3 operator-=(P3 point);    // difference
-    P3 operator*(double n);     // constant product
-    P3 operator*(int n);        // constant product
-    P3 operator/(double n);     // constant quotient
-    P3 operator/(int n);        // constant quotient
+    T x, y, z;
+
+    Point3() {}
+    template<class U, class V, class W>
+    Point3(U x, V y, W z);
+    template<class U>
+    explicit Point3(Point3<U> p);   // other precision
+    T len();                    // length
+    T len2();                   // length square
+    Point3 unit();              // unit vector
+    T operator*(Point3 point);  // dot product
+    T dot(Point3 p);            // dot product
+    Point3 operator%(Point3 point); // cross product, % looks like X
+    Point3 cross(Point3 p);     // cross product
+    Point3 operator+(Point3 point); // sum
+    Point3 operator+=(Point3 point);    // sum
+    Point3 operator-();         // negative
+    Point3 operator-(Point3 point); // difference
+    Point3 operator-=(Point3 point);    // difference
+    Point3 operator*(double n); // constant product
+    Point3 operator*(int n);    // constant product
+    Point3 operator/(double n); // constant quotient
+    Point3 operator/(int n);    // constant quotient
 };
 
-class P2 {
+template<class T>
+class Point2 {
 public:
-    double x, y;
-
-    P2() {}
-    P2(int x, int y);
-    P2(double x, double y);
-    P2(P3 p);
-    double operator*(P2 point);     // dot product
-    double len();                   // length
-    double len2();                  // length square
-    P2 unit();                      // unit vector
-    P2 operator+(P2 point);         // sum
-    P2 operator-(P2 point);         // difference
-    P2 operator-();                 // negative
-    P2 operator+=(P2 point);        // sum
-    P2 operator-=(P2 point);        // difference
-    P2 operator*(double n);         // constant product double
-    P2 operator*(int n);            // constant product int
-    P2 operator/(double n);         // constant quotient double
-    P2 operator/(int n);            // constant quotient int
+    T x, y;
+
+    Point2() {}
+    template<class U, class V>
+    Point2(U x, V y);
+    template<class U>
+    explicit Point2(Point2<U> p);   // other precision
+    Point2(Point3<T> p);
+    T operator*(Point2 point);      // dot product
+    T len();                        // length
+    T len2();                       // length square
+    Point2 unit();                  // unit vector
+    Point2 operator+(Point2 point); // sum
+    Point2 operator-(Point2 point); // difference
+    Point2 operator-();             // negative
+    Point2 operator+=(Point2 point);    // sum
+    Point2 operator-=(Point2 point);    // difference
+    Point2 operator*(double n);     // constant product double
+    Point2 operator*(int n);        // constant product int
+    Point2 operator/(double n);     // constant quotient double
+    Point2 operator/(int n);        // constant quotient int
 };
 
-class P2P {
+template<class T>
+class Pair2 {
 public:
-    P2 p1, p2;
+    Point2<T> p1, p2;
 
-    P2P();
-    P2P(P2 a, P2 b);
-    P2 vector();    // vector
-    double len();   // length of vector
-    double len2();  // length square of vector
+    Pair2();
+    Pair2(Point2<T> a, Point2<T> b);
+    Point2<T> vector(); // vector
+    T len();            // length of vector
+    T len2();           // length square of vector
 };
 
-class P3P {
+template<class T>
+class Pair3 {
 public:
-    P3 p1, p2;
+    Point3<T> p1, p2;
 
-    P3P();
-    P3P(P3 a, P3 b);
-    P3 vector();    // vector
-    double len();   // length of vector
-    double len2();  // length square of vector
+    Pair3();
+    Pair3(Point3<T> a, Point3<T> b);
+    Point3<T> vector(); // vector
+    T len();            // length of vector
+    T len2();           // length square of vector
 };
 
-class P2T {
+template<class T>
+class Tri2 {
 public:
-    P2 p1, p2, p3;
+    Point2<T> p1, p2, p3;
 
-    P2T();
-    P2T(P2 a, P2 b, P2 c);
-    double area();  // area
+    Tri2();
+    Tri2(Point2<T> a, Point2<T> b, Point2<T> c);
+    T area();           // area
 };
 
-class P3T {
+template<class T>
+class Tri3 {
 public:
-    P3 p1, p2, p3;
+    Point3<T> p1, p2, p3;
 
-    P3T();
-    P3T(P3 a, P3 b, P3 c);
-    double area();  // area
-    P3 norm();      // normal vector
+    Tri3();
+    Tri3(Point3<T> a, Point3<T> b, Point3<T> c);
+    T area();           // area
+    Point3<T> norm();   // normal vector
 };
 
-P3 mult(P3 p1, P3 p2);      // multiply 3D pairs
-P2 mult(P2 p1, P2 p2);      // multiply 2D pairs
-P2 div(P2 p1, P2 p2);       // divide 2D pairs
-P3 div(P3 p1, P3 p2);       // divide 3D pairs
-double det(P2 p1, P2 p2);   // delta 2D points
-double det(P3 p1, P3 p2);   // delta 3D points
-double det(P2P pair);       // delta 2D pair
-double det(P3P pair);       // delta 3D pair
-void rotateX(P3 &p, double theta);  // rotate by X axis
-void rotateY(P3 &p, double theta);  // rotate by Y axis
-void rotateZ(P3 &p, double theta);  // rotate by Z axis
+typedef Point2<double> P2;
+typedef Point3<double> P3;
+typedef Pair2<double> P2P;
+typedef Pair3<double> P3P;
+typedef Tri2<double> P2T;
+typedef Tri3<double> P3T;
+typedef Point2<float> P2f;
+typedef Point3<float> P3f;
+typedef Point2<Fixed> P2q;
+typedef Point3<Fixed> P3q;
+
+enum Precision { DOUBLE, FLOAT, FIXED };    // scalar a pipeline projects and rasterizes in
+
+template<class T> Point3<T> mult(Point3<T> p1, Point3<T> p2);   // multiply 3D pairs
+template<class T> Point2<T> mult(Point2<T> p1, Point2<T> p2);   // multiply 2D pairs
+template<class T> Point2<T> div(Point2<T> p1, Point2<T> p2);    // divide 2D pairs
+template<class T> Point3<T> div(Point3<T> p1, Point3<T> p2);    // divide 3D pairs
+template<class T> T det(Point2<T> p1, Point2<T> p2);    // delta 2D points
+template<class T> T det(Point3<T> p1, Point3<T> p2);    // delta 3D points
+template<class T> T det(Pair2<T> pair);                 // delta 2D pair
+template<class T> T det(Pair3<T> pair);                 // delta 3D pair
+template<class T> void rotateX(Point3<T> &p, double theta); // rotate by X axis
+template<class T> void rotateY(Point3<T> &p, double theta); // rotate by Y axis
+template<class T> void rotateZ(Point3<T> &p, double theta); // rotate by Z axis
 
 
 
@@ -116,92 +150,109 @@ void rotateZ(P3 &p, double theta);  // rotate by Z axis
 P2 Member Functions
 */
 
-//P2::P2() {}
-
-P2::P2(int x, int y) {
-    this->x = double(x);
-    this->y = double(y);
+template<class T> template<class U, class V>
+Point2<T>::Point2(U x, V y) {
+    this->x = T(x);
+    this->y = T(y);
 }
 
-P2::P2(double x, double y) {
-    this->x = x;
-    this->y = y;
+// other precision
+template<class T> template<class U>
+Point2<T>::Point2(Point2<U> p) {
+    this->x = T(p.x);
+    this->y = T(p.y);
 }
 
-P2::P2(P3 p) {
+template<class T>
+Point2<T>::Point2(Point3<T> p) {
     this->x = p.x;
     this->y = p.y;
 }
 
 // dot product
-double P2::operator*(P2 point) {
+template<class T>
+T Point2<T>::operator*(Point2 point) {
     return this->x * point.x  + this->y * point.y;
 }
 
-double P2::len() {
 // length
-    return sqrt(x * x + y * y);
+template<class T>
+T Point2<T>::len() {
+    return T(sqrt(double(x * x + y * y)));
 }
 
 // length square
-double P2::len2() {
+template<class T>
+T Point2<T>::len2() {
     return x * x + y * y;
 }
 
 // unit vector
-P2 P2::unit() {
-    return P2(x / len(), y / len());
+template<class T>
+Point2<T> Point2<T>::unit() {
+    return Point2(x / len(), y / len());
 }
 
 // sum
-P2 P2::operator+(P2 point) {
-    return P2(this->x + point.x, this->y + point.y);
+template<class T>
+Point2<T> Point2<T>::operator+(Point2 point) {
+    return Point2(this->x + point.x, this->y + point.y);
 }
 
 // difference
-P2 P2::operator-(P2 point) {
-    return P2(this->x - point.x, this->y - point.y);
+template<class T>
+Point2<T> Point2<T>::operator-(Point2 point) {
+    return Point2(this->x - point.x, this->y - point.y);
 }
 
 // negative
-P2 P2::operator-() {
-    return P2(-this->x, -this->y);
+template<class T>
+Point2<T> Point2<T>::operator-() {
+    return Point2(-this->x, -this->y);
 }
 
-P2 P2::operator+=(P2 point) {
 // sum
+template<class T>
+Point2<T> Point2<T>::operator+=(Point2 point) {
     this->x += point.x;
     this->y += point.y;
+    return *this;
 }
 
-P2 P2::operator-=(P2 point) {
 // difference
+template<class T>
+Point2<T> Point2<T>::operator-=(Point2 point) {
     this->x -= point.x;
     this->y -= point.y;
+    return *this;
 }
 
-P2 P2::operator*(double n) {
 // constant product double
-    return P2(this->x * n, this->y * n);
+template<class T>
+Point2<T> Point2<T>::operator*(double n) {
+    return Point2(this->x * n, this->y * n);
 }
 
 // constant product int
-P2 P2::operator*(int n) {
-    return P2(this->x * double(n), this->y * double(n));
+template<class T>
+Point2<T> Point2<T>::operator*(int n) {
+    return Point2(this->x * double(n), this->y * double(n));
 }
 
 // constant quotient double
-P2 P2::operator/(double n) {
+template<class T>
+Point2<T> Point2<T>::operator/(double n) {
     if(n == 0.0)
-        return P2(0, 0);
-    return P2(this->x / n, this->y / n);
+        return Point2(0, 0);
+    return Point2(this->x / n, this->y / n);
 }
 
 // constant quotient int
-P2 P2::operator/(int n) {
+template<class T>
+Point2<T> Point2<T>::operator/(int n) {
     if(n == 0)
-        return P2(0, 0);
-    return P2(this->x / double(n), this->y / double(n));
+        return Point2(0, 0);
+    return Point2(this->x / double(n), this->y / double(n));
 }
 
 
@@ -215,48 +266,55 @@ P2 P2::operator/(int n) {
 P3 Member Functions
 */
 
-//P3::P3() {}
-
-P3::P3(int x, int y, int z) {
-    this->x = double(x);
-    this->y = double(y);
-    this->z = double(z);
+template<class T> template<class U, class V, class W>
+Point3<T>::Point3(U x, V y, W z) {
+    this->x = T(x);
+    this->y = T(y);
+    this->z = T(z);
 }
 
-P3::P3(double x, double y, double z) {
-    this->x = x;
-    this->y = y;
-    this->z = z;
+// other precision
+template<class T> template<class U>
+Point3<T>::Point3(Point3<U> p) {
+    this->x = T(p.x);
+    this->y = T(p.y);
+    this->z = T(p.z);
 }
 
 // length
-double P3::len() {
-    return sqrt(x * x + y * y + z * z);
+template<class T>
+T Point3<T>::len() {
+    return T(sqrt(double(x * x + y * y + z * z)));
 }
 
 // length square
-double P3::len2() {
+template<class T>
+T Point3<T>::len2() {
     return x * x + y * y + z * z;
 }
 
 // unit vector
-P3 P3::unit() {
-    return P3(x / len(), y / len(), z / len());
+template<class T>
+Point3<T> Point3<T>::unit() {
+    return Point3(x / len(), y / len(), z / len());
 }
 
 // dot product
-double P3::operator*(P3 point) {
+template<class T>
+T Point3<T>::operator*(Point3 point) {
     return point.x * x + point.y * y + point.z * z;
 }
 
 // dot product
-double P3::dot(P3 p) {
+template<class T>
+T Point3<T>::dot(Point3 p) {
     return p.x * z + p.y * y + p.z * z;
 }
 
 // cross product              % looks like X
-P3 P3::operator%(P3 point) {
-    return P3(
+template<class T>
+Point3<T> Point3<T>::operator%(Point3 point) {
+    return Point3(
         x * point.z - z * point.y,
         z * point.x - x * point.z,
         y * point.y - y * point.x
@@ -264,61 +322,73 @@ P3 P3::operator%(P3 point) {
 }
 
 // cross product
-P3 P3::cross(P3 p) {
-    return P3(y * p.z - z * p.y, z * p.x - x * p.z, x * p.y - y * p.x);
+template<class T>
+Point3<T> Point3<T>::cross(Point3 p) {
+    return Point3(y * p.z - z * p.y, z * p.x - x * p.z, x * p.y - y * p.x);
 }
 
 // sum
-P3 P3::operator+(P3 point) {
-    return P3(this->x + point.x, this->y + point.y, this->z + point.z);
+template<class T>
+Point3<T> Point3<T>::operator+(Point3 point) {
+    return Point3(this->x + point.x, this->y + point.y, this->z + point.z);
 }
 
 // sum
-P3 P3::operator+=(P3 point) {
+template<class T>
+Point3<T> Point3<T>::operator+=(Point3 point) {
     this->x += point.x;
     this->y += point.y;
     this->z += point.z;
+    return *this;
 }
 
 // negative
-P3 P3::operator-() {
-    return P3(-this->x, -this->y, -this->z);
+template<class T>
+Point3<T> Point3<T>::operator-() {
+    return Point3(-this->x, -this->y, -this->z);
 }
 
 // difference
-P3 P3::operator-(P3 point) {
-    return P3(this->x - point.x, this->y - point.y, this->z - point.z);
+template<class T>
+Point3<T> Point3<T>::operator-(Point3 point) {
+    return Point3(this->x - point.x, this->y - point.y, this->z - point.z);
 }
 
 // difference
-P3 P3::operator-=(P3 point) {
+template<class T>
+Point3<T> Point3<T>::operator-=(Point3 point) {
     this->x -= point.x;
     this->y -= point.y;
     this->z -= point.z;
+    return *this;
 }
 
 // constant product
-P3 P3::operator*(double n) {
-    return P3(this->x * n, this->y * n, this->z * n);
+template<class T>
+Point3<T> Point3<T>::operator*(double n) {
+    return Point3(this->x * n, this->y * n, this->z * n);
 }
 
 // constant product
-P3 P3::operator*(int n) {
-    return P3(this->x * double(n), this->y * double(n), this->z * double(n));
+template<class T>
+Point3<T> Point3<T>::operator*(int n) {
+    return Point3(this->x * double(n), this->y * double(n), this->z * double(n));
 }
 
 // constant quotient
-P3 P3::operator/(double n) {
+template<class T>
+Point3<T> Point3<T>::operator/(double n) {
     if(n == 0.0)
-    return P3(0, 0, 0);
-    return P3(this->x / n, this->y / n, this->z / n);
+        return Point3(0, 0, 0);
+    return Point3(this->x / n, this->y / n, this->z / n);
 }
 
 // constant quotient
-P3 P3::operator/(int n) {
+template<class T>
+Point3<T> Point3<T>::operator/(int n) {
     if(n == 0)
-        return P3(0, 0, 0);
-    return P3(this->x / double(n), this->y / double(n), this->z / double(n));
+        return Point3(0, 0, 0);
+    return Point3(this->x / double(n), this->y / double(n), this->z / double(n));
 }
 
 
@@ -332,26 +402,31 @@ P3 P3::operator/(int n) {
 P2P Member Functions
 */
 
-P2P::P2P() {
-    p2 = p1 = P2(0, 0);
+template<class T>
+Pair2<T>::Pair2() {
+    p2 = p1 = Point2<T>(0, 0);
 }
 
-P2P::P2P(P2 a, P2 b) {
+template<class T>
+Pair2<T>::Pair2(Point2<T> a, Point2<T> b) {
     p1 = a, p2 = b;
 }
 
 // vector
-P2 P2P::vector() {
+template<class T>
+Point2<T> Pair2<T>::vector() {
     return p2 - p1;
 }
 
 // length of vector
-double P2P::len() {
+template<class T>
+T Pair2<T>::len() {
     return vector().len();
 }
 
 // length square of vector
-double P2P::len2() {
+template<class T>
+T Pair2<T>::len2() {
     return vector().len2();
 }
 
@@ -366,26 +441,31 @@ double P2P::len2() {
 P3P Member Functions
 */
 
-P3P::P3P() {
-    p2 = p1 = P3(0, 0, 0);
+template<class T>
+Pair3<T>::Pair3() {
+    p2 = p1 = Point3<T>(0, 0, 0);
 }
 
-P3P::P3P(P3 a, P3 b) {
+template<class T>
+Pair3<T>::Pair3(Point3<T> a, Point3<T> b) {
     p1 = a, p2 = b;
 }
 
 // vector
-P3 P3P::vector() {
+template<class T>
+Point3<T> Pair3<T>::vector() {
     return p2 - p1;
 }
 
 // length of vector
-double P3P::len() {
+template<class T>
+T Pair3<T>::len() {
     return vector().len();
 }
 
 // length square of vector
-double P3P::len2() {
+template<class T>
+T Pair3<T>::len2() {
     return vector().len2();
 }
 
@@ -400,17 +480,20 @@ double P3P::len2() {
 P2T Member Functions
 */
 
-P2T::P2T() {
-    p3 = p2 = p1 = P2(0, 0);
+template<class T>
+Tri2<T>::Tri2() {
+    p3 = p2 = p1 = Point2<T>(0, 0);
 }
 
-P2T::P2T(P2 a, P2 b, P2 c) {
+template<class T>
+Tri2<T>::Tri2(Point2<T> a, Point2<T> b, Point2<T> c) {
     p1 = a, p2 = b, p3 = c;
 }
 
 // area
-double P2T::area() {
-    return fabs(det(p2 - p1, p3 - p1)) / 2.0;
+template<class T>
+T Tri2<T>::area() {
+    return T(fabs(double(det(p2 - p1, p3 - p1))) / 2.0);
 }
 
 
@@ -424,21 +507,25 @@ double P2T::area() {
 P3T Member Functions
 */
 
-P3T::P3T() {
-    p3 = p2 = p1 = P3(0, 0, 0);
+template<class T>
+Tri3<T>::Tri3() {
+    p3 = p2 = p1 = Point3<T>(0, 0, 0);
 }
 
-P3T::P3T(P3 a, P3 b, P3 c) {
+template<class T>
+Tri3<T>::Tri3(Point3<T> a, Point3<T> b, Point3<T> c) {
     p1 = a, p2 = b, p3 = c;
 }
 
 // area
-double P3T::area() {
-    return fabs(det(p2 - p1, p3 - p1)) / 2.0;
+template<class T>
+T Tri3<T>::area() {
+    return T(fabs(double(det(p2 - p1, p3 - p1))) / 2.0);
 }
 
 // normal vector
-P3 P3T::norm() {
+template<class T>
+Point3<T> Tri3<T>::norm() {
     return (p2 - p1) % (p3 - p1);
 }
 
@@ -454,75 +541,86 @@ Extra Functions
 */
 
 // multiply 3D pairs
-P3 mult(P3 p1, P3 p2) {
-    return P3(p1.x * p2.x, p1.y * p2.y, p1.z * p2.z);
+template<class T>
+Point3<T> mult(Point3<T> p1, Point3<T> p2) {
+    return Point3<T>(p1.x * p2.x, p1.y * p2.y, p1.z * p2.z);
 }
 
 // multiply 2D pairs
-P2 mult(P2 p1, P2 p2) {
-    return P2(p1.x * p2.x, p1.y * p2.y);
+template<class T>
+Point2<T> mult(Point2<T> p1, Point2<T> p2) {
+    return Point2<T>(p1.x * p2.x, p1.y * p2.y);
 }
 
 // divide 2D pairs
-P2 div(P2 p1, P2 p2) {
-    if(p2.x * p2.y == 0)
+template<class T>
+Point2<T> div(Point2<T> p1, Point2<T> p2) {
+    if(p2.x * p2.y == T(0))
     return p1;
     else
-    return P2(p1.x / p2.x, p1.y / p2.y);
+    return Point2<T>(p1.x / p2.x, p1.y / p2.y);
 }
 
 // divide 3D pairs
-P3 div(P3 p1, P3 p2) {
-    if(p2.x * p2.y * p2.z == 0)
+template<class T>
+Point3<T> div(Point3<T> p1, Point3<T> p2) {
+    if(p2.x * p2.y * p2.z == T(0))
     return p1;
     else
-    return P3(p1.x / p2.x, p1.y / p2.y, p1.z / p2.z);
+    return Point3<T>(p1.x / p2.x, p1.y / p2.y, p1.z / p2.z);
 }
 
 // delta 2D points
-double det(P2 p1, P2 p2) {
+template<class T>
+T det(Point2<T> p1, Point2<T> p2) {
     return p1.x * p2.y - p1.y * p2.x;
 }
 
 // delta 3D points
-double det(P3 p1, P3 p2) {
+template<class T>
+T det(Point3<T> p1, Point3<T> p2) {
     return p1.x * p2.y - p1.y * p2.x + p1.y * p2.z - p1.z * p2.y + p1.z * p2.x - p1.x * p2.z;
 }
 
 // delta 2D pair
-double det(P2P pair) {
-    P2 p1 = pair.p1, p2 = pair.p2;
+template<class T>
+T det(Pair2<T> pair) {
+    Point2<T> p1 = pair.p1, p2 = pair.p2;
     return p1.x * p2.y - p1.y * p2.x;
 }
 
 // delta 3D pair
-double det(P3P pair) {
-    P3 p1 = pair.p1, p2 = pair.p2;
+template<class T>
+T det(Pair3<T> pair) {
+    Point3<T> p1 = pair.p1, p2 = pair.p2;
     return p1.x * p2.y - p1.y * p2.x + p1.y * p2.z - p1.z * p2.y + p1.z * p2.x - p1.x * p2.z;
 }
 
 // rotate by X axis
-void rotateX(P3 &p, double theta) {
+template<class T>
+void rotateX(Point3<T> &p, double theta) {
     double rad = (theta * 3.1416) / 180.0;
-    double y = p.y * cos(rad) - p.z * sin(rad);
-    double z = p.y * sin(rad) + p.z * cos(rad);
-    p = P3(p.x, y, z);
+    double y = double(p.y) * cos(rad) - double(p.z) * sin(rad);
+    double z = double(p.y) * sin(rad) + double(p.z) * cos(rad);
+    p = Point3<T>(p.x, y, z);
 }
 
 // rotate by Y axis
-void rotateY(P3 &p, double theta) {
+template<class T>
+void rotateY(Point3<T> &p, double theta) {
     double rad = (theta * 3.1416) / 180.0;
-    double z = p.z * cos(rad) - p.x * sin(rad);
-    double x = p.z * sin(rad) + p.x * cos(rad);
-    p = P3(x, p.y, z);
+    double z = double(p.z) * cos(rad) - double(p.x) * sin(rad);
+    double x = double(p.z) * sin(rad) + double(p.x) * cos(rad);
+    p = Point3<T>(x, p.y, z);
 }
 
 // rotate by Z axis
-void rotateZ(P3 &p, double theta) {
+template<class T>
+void rotateZ(Point3<T> &p, double theta) {
     double rad = (theta * 3.1416) / 180.0;
-    double x = p.x * cos(rad) - p.y * sin(rad);
-    double y = p.x * sin(rad) + p.y * cos(rad);
-    p = P3(x, y, p.z);
+    double x = double(p.x) * cos(rad) - double(p.y) * sin(rad);
+    double y = double(p.x) * sin(rad) + double(p.y) * cos(rad);
+    p = Point3<T>(x, y, p.z);
 }
 
 
@@ -3,8 +3,14 @@
 
 #include <iostream>
 #include "bitmap.h"
+#include "convolution.h"
+#include "scratch.h"
+#include "lut.h"
 #include <math.h>
 
+void diskBlur(const RGB *src, int sstride, RGB *dst, int dstride, int w, int h, int r,
+              int vx0, int vy0, int vx1, int vy1, ScratchPool& pool, int slot);
+
 class ImageProcessor {
 public:
     ImageProcessor(Bitmap *bmp);
@@ -15,10 +21,42 @@ public:
     bool GaussianBlur(int r);
     bool GaussianBlur(P2P range, int r);
     void pixelate(int n);
+    bool convolve(Kernel k, bool separable);    // convolve range with kernel
+    bool sharpen();
+    bool emboss();
+    bool sobel();                               // edge magnitude
+    bool unsharpMask(int r, double amount);     // original + amount * (original - blur)
+    bool lut(ColorLUT& lut);                    // color transform range
+    bool grayscale();                           // RGB::avg() over range
+    size_t scratchBytes();                      // scratch memory held
+    void releaseScratch();                      // free scratch memory
 private:
     Bitmap *bmp;
     P2P range;
     int _r, _l, _d, _u;
+    ScratchPool pool;
+    bool region(int& x0, int& y0, int& x1, int& y1);  // range in buffer coordinates
+};
+
+/*
+RowWindow
+
+the 2 * ry + 1 original rows around the current one, padded by rx and
+clamped at the image border, so a filter can write each finished row
+straight back into the bitmap. Every row is stored twice in a ring of
+2 * (2 * ry + 1) rows, which keeps the window contiguous.
+Rows must be requested in order.
+*/
+class RowWindow {
+public:
+    RowWindow(Bitmap *bmp, ScratchPool& pool, int slot, int x0, int x1, int y0, int rx, int ry);
+    const RGB *at(int y);   // pixel (x0, y), rows y - ry .. y + ry readable
+    int stride();
+private:
+    Bitmap *bmp;
+    RGB *ring;
+    int x0, x1, rx, ry, n, pw, next;
+    void copy(int y);       // original row y into the ring
 };
 
 ImageProcessor::ImageProcessor(Bitmap *bmp) {
@@ -36,7 +74,7 @@ void ImageProcessor::drawRange(RGB c) {
 void ImageProcessor::rerange() {
     rerange(P2P(
         P2(-bmp->getOrigin().x, -bmp->getOrigin().y),
-        P2(bmp->getWidth() - bmp->getOrigin().x, bmp->getWidth() - bmp->getOrigin().y)
+        P2(bmp->getWidth() - bmp->getOrigin().x, bmp->getHeight() - bmp->getOrigin().y)
     ));
 }
 
@@ -61,39 +99,250 @@ bool ImageProcessor::GaussianBlur(P2P p2p, int r = 1) {
 }
 
 bool ImageProcessor::GaussianBlur(int r = 1) {
-    P2 o = bmp->getOrigin();
-    int w = bmp->getWidth(), h = bmp->getHeight();
-    if(w * h > 2073600)
+    PROFILE_SCOPE("ImageProcessor::GaussianBlur");
+    int x0, y0, x1, y1;
+    if(!region(x0, y0, x1, y1))
         return false;
-    RGB *buffer = new RGB[w * h];
-    for(int x = 0; x < w; x++)
-        for(int y = 0; y < h; y++)
-            buffer[y * w + x] = bmp->get(P2(x - o.x, y - o.y));
-    for(int x = _l; x < _r; x++) {
-        for(int y = _d; y < _u; y++) {
-            if(x < 0 - o.x || x >= w - o.x || y < 0 - o.y || y >= h - o.y)
-                continue;
-            int count = 0, R = 0, G = 0, B = 0;
-            for(int i = x - r; i <= x + r; i++) {
-                for(int j = y - r; j <= y + r; j++) {
-                    int xd = i - x, yd = j - y;
-                    if(xd * xd + yd * yd <= r * r && i >= 0 - o.x && j >= 0 - o.y && i < w - o.x && j < h - o.y) {
-                        RGB temp = bmp->get(P2(i, j));
-                        R += temp.R, G += temp.G, B += temp.B, count++;
-                    }
-                }
-            }
-            buffer[(y + int(o.y)) * w + x + int(o.x)] = RGB(
-                (unsigned char)(R / count),
-                (unsigned char)(G / count),
-                (unsigned char)(B / count)
-            );
+    int w = bmp->getWidth(), h = bmp->getHeight(), stride = bmp->getStride();
+    RGB *block = bmp->row(y0) + x0;
+    diskBlur(block, stride, block, stride, x1 - x0, y1 - y0, r, -x0, -y0, w - x0, h - y0, pool, 0);
+    return true;
+}
+
+// average every n x n block of the range
+void ImageProcessor::pixelate(int n) {
+    PROFILE_SCOPE("ImageProcessor::pixelate");
+    int x0, y0, x1, y1;
+    if(n < 2 || !region(x0, y0, x1, y1))
+        return;
+    int w = bmp->getStride();
+    RGB *buffer = bmp->getBuffer();
+    for(int by = y0; by < y1; by += n) {
+        int ey = by + n < y1 ? by + n : y1;
+        for(int bx = x0; bx < x1; bx += n) {
+            int ex = bx + n < x1 ? bx + n : x1;
+            int R = 0, G = 0, B = 0, count = (ex - bx) * (ey - by);
+            for(int y = by; y < ey; y++)
+                for(int x = bx; x < ex; x++)
+                    R += buffer[y * w + x].R, G += buffer[y * w + x].G, B += buffer[y * w + x].B;
+            RGB c((unsigned char)(R / count), (unsigned char)(G / count), (unsigned char)(B / count));
+            for(int y = by; y < ey; y++)
+                for(int x = bx; x < ex; x++)
+                    buffer[y * w + x] = c;
         }
     }
-    bmp->setBuffer(buffer);
+}
+
+// convolve range with kernel
+bool ImageProcessor::convolve(Kernel k, bool separable = true) {
+    PROFILE_SCOPE("ImageProcessor::convolve");
+    int x0, y0, x1, y1;
+    if(!region(x0, y0, x1, y1))
+        return false;
+    Convolver conv(k, separable);
+    RowWindow src(bmp, pool, 0, x0, x1, y0, conv.rx, conv.ry);
+    int w = bmp->getStride();
+    RGB *buffer = bmp->getBuffer();
+    for(int y = y0; y < y1; y++)
+        conv.row(src.at(y), src.stride(), x1 - x0, buffer + y * w + x0);
+    return true;
+}
+
+bool ImageProcessor::sharpen() {
+    return convolve(Kernel::sharpen());
+}
+
+bool ImageProcessor::emboss() {
+    return convolve(Kernel::emboss());
+}
+
+// edge magnitude
+bool ImageProcessor::sobel() {
+    PROFILE_SCOPE("ImageProcessor::sobel");
+    int x0, y0, x1, y1;
+    if(!region(x0, y0, x1, y1))
+        return false;
+    Kernel kx = Kernel::sobelX(), ky = Kernel::sobelY();
+    Convolver cx(kx), cy(ky);
+    RowWindow src(bmp, pool, 0, x0, x1, y0, 1, 1);
+    int n = (x1 - x0) * 3, w = bmp->getStride();
+    int *gx = pool.get<int>(1, 2 * n), *gy = gx + n;
+    RGB *buffer = bmp->getBuffer();
+    for(int y = y0; y < y1; y++) {
+        const RGB *s = src.at(y);
+        cx.row(s, src.stride(), x1 - x0, gx);
+        cy.row(s, src.stride(), x1 - x0, gy);
+        unsigned char *d = (unsigned char*)(buffer + y * w + x0);
+        for(int c = 0; c < n; c++) {
+            int m = int(sqrt(double(gx[c] * gx[c] + gy[c] * gy[c])));
+            d[c] = (unsigned char)(m > 255 ? 255 : m);
+        }
+    }
+    return true;
+}
+
+// original + amount * (original - blur)
+bool ImageProcessor::unsharpMask(int r, double amount) {
+    PROFILE_SCOPE("ImageProcessor::unsharpMask");
+    int x0, y0, x1, y1;
+    if(!region(x0, y0, x1, y1))
+        return false;
+    Kernel k = Kernel::gaussian(r);
+    Convolver conv(k);
+    RowWindow src(bmp, pool, 0, x0, x1, y0, r, r);
+    int n = (x1 - x0) * 3, w = bmp->getStride();
+    int a = int(amount * 256);
+    int *blur = pool.get<int>(1, n);
+    RGB *buffer = bmp->getBuffer();
+    for(int y = y0; y < y1; y++) {
+        const RGB *s = src.at(y);
+        conv.row(s, src.stride(), x1 - x0, blur);
+        const unsigned char *o = (const unsigned char*)s;
+        unsigned char *d = (unsigned char*)(buffer + y * w + x0);
+        for(int c = 0; c < n; c++) {
+            int v = o[c] + ((a * (o[c] - blur[c]) + 128) >> 8);
+            d[c] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+    }
+    return true;
+}
+
+// color transform range
+bool ImageProcessor::lut(ColorLUT& lut) {
+    PROFILE_SCOPE("ImageProcessor::lut");
+    int x0, y0, x1, y1;
+    if(!region(x0, y0, x1, y1))
+        return false;
+    int w = bmp->getStride();
+    for(int y = y0; y < y1; y++)
+        lut.apply(bmp->getBuffer() + y * w + x0, x1 - x0);
     return true;
-    delete [] buffer;
 }
 
+// RGB::avg() over range
+bool ImageProcessor::grayscale() {
+    PROFILE_SCOPE("ImageProcessor::grayscale");
+    int x0, y0, x1, y1;
+    if(!region(x0, y0, x1, y1))
+        return false;
+    int w = bmp->getStride();
+    for(int y = y0; y < y1; y++)
+        ::grayscale(bmp->getBuffer() + y * w + x0, x1 - x0);
+    return true;
+}
+
+// scratch memory held
+size_t ImageProcessor::scratchBytes() {
+    return pool.bytes();
+}
+
+// free scratch memory
+void ImageProcessor::releaseScratch() {
+    pool.clear();
+}
+
+// range in buffer coordinates
+bool ImageProcessor::region(int& x0, int& y0, int& x1, int& y1) {
+    int ox = int(bmp->getOrigin().x), oy = int(bmp->getOrigin().y);
+    int w = bmp->getWidth(), h = bmp->getHeight();
+    x0 = _l + ox < 0 ? 0 : _l + ox;
+    y0 = _d + oy < 0 ? 0 : _d + oy;
+    x1 = _r + ox > w ? w : _r + ox;
+    y1 = _u + oy > h ? h : _u + oy;
+    return x0 < x1 && y0 < y1;
+}
+
+
+/******************************************************************************/
+//  RowWindow Member Functions
+/******************************************************************************/
+
+RowWindow::RowWindow(Bitmap *bmp, ScratchPool& pool, int slot, int x0, int x1, int y0, int rx, int ry) {
+    this->bmp = bmp;
+    this->x0 = x0, this->x1 = x1, this->rx = rx, this->ry = ry;
+    n = 2 * ry + 1, pw = x1 - x0 + 2 * rx;
+    ring = pool.get<RGB>(slot, 2 * n * pw);
+    for(int y = y0 - ry; y < y0 + ry; y++)
+        copy(y);
+    next = y0 + ry;
+}
+
+// pixel (x0, y), rows y - ry .. y + ry readable
+const RGB *RowWindow::at(int y) {
+    while(next <= y + ry)
+        copy(next++);
+    int k = ((y - ry) % n + n) % n;
+    return ring + (k + ry) * pw + rx;
+}
+
+int RowWindow::stride() {
+    return pw;
+}
+
+// original row y into the ring
+void RowWindow::copy(int y) {
+    int w = bmp->getWidth(), h = bmp->getHeight();
+    int k = (y % n + n) % n;
+    RGB *a = ring + k * pw, *b = ring + (k + n) * pw;
+    const RGB *row = bmp->row(y < 0 ? 0 : (y >= h ? h - 1 : y));
+    for(int i = 0; i < pw; i++) {
+        int x = x0 - rx + i;
+        a[i] = b[i] = row[x < 0 ? 0 : (x >= w ? w - 1 : x)];
+    }
+}
+
+
+/******************************************************************************/
+//  Filters
+/******************************************************************************/
+
+// disk average of radius r over a w x h block; src is padded by r on every side
+// and only pixels inside [vx0, vx1) x [vy0, vy1) (block coordinates) are counted.
+// Source rows are consumed into a ring of prefix sums before the output row that
+// overwrites them is written, so src == dst (in place) is fine.
+void diskBlur(const RGB *src, int sstride, RGB *dst, int dstride, int w, int h, int r,
+              int vx0, int vy0, int vx1, int vy1, ScratchPool& pool, int slot) {
+    int pw = w + 2 * r, n = 2 * r + 1, rs = (pw + 1) * 4;
+    int *ring = pool.get<int>(slot, n * rs + n); // prefix sums B G R count of the last n rows
+    int *span = ring + n * rs;                   // half width of the disk per row
+    for(int d = -r; d <= r; d++) {
+        int k = 0;
+        while((k + 1) * (k + 1) + d * d <= r * r)
+            k++;
+        span[d + r] = k;
+    }
+    for(int j = -r; j < h + r; j++) {
+        int *p = ring + ((j + r) % n) * rs;
+        p[0] = p[1] = p[2] = p[3] = 0;
+        bool rowValid = j >= vy0 && j < vy1;
+        const unsigned char *s = rowValid ? (const unsigned char*)(src + j * sstride - r) : NULL;
+        for(int i = 0; i < pw; i++) {
+            int x = i - r, *q = p + i * 4;
+            if(s && x >= vx0 && x < vx1)
+                q[4] = q[0] + s[i * 3], q[5] = q[1] + s[i * 3 + 1], q[6] = q[2] + s[i * 3 + 2], q[7] = q[3] + 1;
+            else
+                q[4] = q[0], q[5] = q[1], q[6] = q[2], q[7] = q[3];
+        }
+        int y = j - r;
+        if(y < 0)
+            continue;
+        unsigned char *d = (unsigned char*)(dst + y * dstride);
+        for(int x = 0; x < w; x++) {
+            int B = 0, G = 0, R = 0, count = 0;
+            for(int dy = 0; dy < n; dy++) {
+                const int *q = ring + ((y + dy) % n) * rs;
+                const int *a = q + (x + r - span[dy]) * 4, *b = q + (x + r + span[dy] + 1) * 4;
+                B += b[0] - a[0], G += b[1] - a[1], R += b[2] - a[2], count += b[3] - a[3];
+            }
+            if(count) {
+                d[x * 3] = (unsigned char)(B / count);
+                d[x * 3 + 1] = (unsigned char)(G / count);
+                d[x * 3 + 2] = (unsigned char)(R / count);
+            }
+        }
+    }
+}
+
+
 
 #endif /* __PROCESSOR_H__ */
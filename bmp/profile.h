@@ -0,0 +1,323 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <vector>
+#include <map>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+/*
+Profiler
+
+scoped timers and counters for the hot paths, enabled by compiling
+with -DBMP_PROFILE; without it every PROFILE_ macro compiles to nothing
+and the library runs exactly as before
+
+    PROFILE_SCOPE("Camera::shot");          // times the enclosing block
+    PROFILE_COUNT(PIXELS_WRITTEN, n);       // adds n to a counter
+    PROFILE_FRAME();                        // closes the current frame
+
+    profiler().writeTrace("trace.json");    // chrome://tracing or Perfetto
+    profiler().summary(cout);               // per-frame table
+
+a frame collects the scopes that ended and the counts made since the
+previous PROFILE_FRAME (or since the start). Scope times are inclusive:
+a line drawn inside Camera::shot counts for both. Each thread records
+into its own buffer, so scopes on different workers never wait for each
+other; PROFILE_FRAME and the dumps merge the buffers. Only the first
+maxEvents scopes of each thread are kept for the trace, the frame totals
+see them all.
+*/
+enum ProfileCounter { PIXELS_WRITTEN, PIXELS_CLIPPED, LINES, TRIANGLES, PATCHES, BYTES_WRITTEN, COUNTERS };
+
+class Profiler {
+public:
+    struct Event {
+        const char *name;
+        double start, duration;     // microseconds since the profiler started
+        int thread;
+    };
+    struct Stat {
+        long long calls;
+        double total;               // microseconds
+    };
+    struct Less {
+        bool operator()(const char *a, const char *b) const { return strcmp(a, b) < 0; }
+    };
+    struct Frame {
+        double start, duration;
+        map<const char*, Stat, Less> scopes;
+        long long counters[COUNTERS];
+    };
+    size_t maxEvents;                               // per thread
+
+    Profiler();
+    ~Profiler();
+    double now();                                   // microseconds since the profiler started
+    void record(const char *name, double start, double end);
+    void count(ProfileCounter c, long long n);
+    long long counter(ProfileCounter c);            // total since the start
+    void frame();                                   // close the current frame
+    const vector<Frame>& frames();
+    bool writeTrace(const char *name);              // Chrome trace-event JSON
+    void summary(ostream& out);                     // one table per frame
+    void clear();
+    static const char *counterName(ProfileCounter c);
+    static int thread();                            // small id of the calling thread
+private:
+    struct Local {                                  // what one thread recorded since the last frame
+        mutex lock;                                 // only contended while frame() or a dump merges
+        int thread;
+        vector< pair<const char*, Stat> > scopes;   // few names, found by pointer
+        vector<Event> events;
+    };
+    chrono::steady_clock::time_point origin;
+    mutex lock;
+    int id;                                         // tells profilers apart in the per-thread cache
+    vector<Local*> locals;
+    vector<Frame> done;
+    Frame current;
+    atomic<long long> counters[COUNTERS];
+    long long marked[COUNTERS];                     // counters when the current frame began
+    Local& local();                                 // the calling thread's buffer
+};
+
+Profiler& profiler();   // the one every PROFILE_ macro reports to
+
+/*
+ProfileScope
+
+records the time from its construction to its destruction
+*/
+class ProfileScope {
+public:
+    ProfileScope(const char *name);
+    ~ProfileScope();
+private:
+    const char *name;
+    double start;
+};
+
+#ifdef BMP_PROFILE
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_JOIN(profileScope, __LINE__)(name)
+#define PROFILE_COUNT(counter, n) profiler().count(counter, n)
+#define PROFILE_FRAME() profiler().frame()
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_COUNT(counter, n) ((void)sizeof(n))    // not evaluated
+#define PROFILE_FRAME() ((void)0)
+#endif
+
+
+/******************************************************************************/
+//  Profiler Member Functions
+/******************************************************************************/
+
+Profiler::Profiler() {
+    static atomic<int> profilers(0);
+    id = ++profilers;
+    maxEvents = 1 << 20;
+    for(int i = 0; i < COUNTERS; i++)
+        counters[i] = 0;
+    clear();
+}
+
+Profiler::~Profiler() {
+    for(size_t i = 0; i < locals.size(); i++)
+        delete locals[i];
+}
+
+// microseconds since the profiler started
+double Profiler::now() {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - origin).count();
+}
+
+// into the calling thread's buffer; no lock is shared with other threads
+void Profiler::record(const char *name, double start, double end) {
+    Local &l = local();
+    lock_guard<mutex> guard(l.lock);
+    size_t i = 0;
+    while(i < l.scopes.size() && l.scopes[i].first != name)
+        i++;
+    if(i == l.scopes.size()) {
+        Stat s = { 0, 0 };
+        l.scopes.push_back(make_pair(name, s));
+    }
+    l.scopes[i].second.calls++, l.scopes[i].second.total += end - start;
+    if(l.events.size() < maxEvents) {
+        Event e = { name, start, end - start, l.thread };
+        l.events.push_back(e);
+    }
+}
+
+// the calling thread's buffer, registered on its first scope
+Profiler::Local& Profiler::local() {
+    static thread_local int owner = 0;
+    static thread_local Local *mine = NULL;
+    if(owner != id) {
+        lock_guard<mutex> guard(lock);
+        int t = thread();
+        mine = NULL;
+        for(size_t i = 0; i < locals.size() && !mine; i++)
+            if(locals[i]->thread == t)
+                mine = locals[i];
+        if(!mine) {
+            mine = new Local;
+            mine->thread = t;
+            locals.push_back(mine);
+        }
+        owner = id;
+    }
+    return *mine;
+}
+
+void Profiler::count(ProfileCounter c, long long n) {
+    counters[c].fetch_add(n, memory_order_relaxed);
+}
+
+// total since the start
+long long Profiler::counter(ProfileCounter c) {
+    return counters[c].load();
+}
+
+// close the current frame
+void Profiler::frame() {
+    lock_guard<mutex> guard(lock);
+    for(size_t i = 0; i < locals.size(); i++) {
+        lock_guard<mutex> hold(locals[i]->lock);
+        vector< pair<const char*, Stat> > &scopes = locals[i]->scopes;
+        for(size_t k = 0; k < scopes.size(); k++) {
+            Stat &s = current.scopes[scopes[k].first];
+            s.calls += scopes[k].second.calls, s.total += scopes[k].second.total;
+        }
+        scopes.clear();
+    }
+    double t = now();
+    current.duration = t - current.start;
+    for(int i = 0; i < COUNTERS; i++) {
+        long long v = counters[i].load();
+        current.counters[i] = v - marked[i], marked[i] = v;
+    }
+    done.push_back(current);
+    current.scopes.clear();
+    current.start = t;
+}
+
+const vector<Profiler::Frame>& Profiler::frames() {
+    return done;
+}
+
+// Chrome trace-event JSON: one complete event per scope, and at the end
+// of every frame an instant event and the frame's counts
+bool Profiler::writeTrace(const char *name) {
+    lock_guard<mutex> guard(lock);
+    vector<Event> events;
+    for(size_t i = 0; i < locals.size(); i++) {
+        lock_guard<mutex> hold(locals[i]->lock);
+        events.insert(events.end(), locals[i]->events.begin(), locals[i]->events.end());
+    }
+    sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.start < b.start; });
+    FILE *file = fopen(name, "w");
+    if(!file)
+        return false;
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    const char *sep = "\n";
+    for(size_t i = 0; i < events.size(); i++, sep = ",\n")
+        fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d}",
+            sep, events[i].name, events[i].start, events[i].duration, events[i].thread);
+    for(size_t f = 0; f < done.size(); f++, sep = ",\n") {
+        double end = done[f].start + done[f].duration;
+        fprintf(file, "%s{\"name\": \"frame %d\", \"ph\": \"i\", \"s\": \"g\", \"ts\": %.3f, \"pid\": 1, \"tid\": 0}", sep, int(f), end);
+        fprintf(file, ",\n{\"name\": \"counters\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, \"args\": {", end);
+        for(int i = 0; i < COUNTERS; i++)
+            fprintf(file, "%s\"%s\": %lld", i ? ", " : "", counterName(ProfileCounter(i)), done[f].counters[i]);
+        fprintf(file, "}}");
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+// one table per frame, slowest scope first
+void Profiler::summary(ostream& out) {
+    lock_guard<mutex> guard(lock);
+    char text[160];
+    for(size_t f = 0; f < done.size(); f++) {
+        const Frame &frame = done[f];
+        snprintf(text, sizeof(text), "frame %d: %.3f ms\n", int(f), frame.duration / 1000);
+        out << text;
+        vector< pair<double, const char*> > order;
+        for(map<const char*, Stat, Less>::const_iterator it = frame.scopes.begin(); it != frame.scopes.end(); ++it)
+            order.push_back(make_pair(-it->second.total, it->first));
+        sort(order.begin(), order.end());
+        for(size_t i = 0; i < order.size(); i++) {
+            const Stat &s = frame.scopes.find(order[i].second)->second;
+            snprintf(text, sizeof(text), "  %-32s %10lld calls %12.3f ms %7.1f%%\n", order[i].second, s.calls,
+                s.total / 1000, frame.duration > 0 ? 100 * s.total / frame.duration : 0.0);
+            out << text;
+        }
+        for(int i = 0; i < COUNTERS; i++) {
+            snprintf(text, sizeof(text), "  %-32s %10lld\n", counterName(ProfileCounter(i)), frame.counters[i]);
+            out << text;
+        }
+    }
+}
+
+void Profiler::clear() {
+    lock_guard<mutex> guard(lock);
+    origin = chrono::steady_clock::now();
+    for(size_t i = 0; i < locals.size(); i++) {
+        lock_guard<mutex> hold(locals[i]->lock);
+        locals[i]->scopes.clear();
+        locals[i]->events.clear();
+    }
+    done.clear();
+    current.scopes.clear();
+    current.start = current.duration = 0;
+    for(int i = 0; i < COUNTERS; i++)
+        marked[i] = counters[i].load();
+}
+
+const char *Profiler::counterName(ProfileCounter c) {
+    static const char *names[COUNTERS] = {
+        "pixels_written", "pixels_clipped", "lines", "triangles", "patches", "bytes_written"
+    };
+    return names[c];
+}
+
+// small id of the calling thread
+int Profiler::thread() {
+    static atomic<int> next(0);
+    static thread_local int id = next++;
+    return id;
+}
+
+Profiler& profiler() {
+    static Profiler p;
+    return p;
+}
+
+
+/******************************************************************************/
+//  ProfileScope Member Functions
+/******************************************************************************/
+
+ProfileScope::ProfileScope(const char *name) {
+    this->name = name;
+    start = profiler().now();
+}
+
+ProfileScope::~ProfileScope() {
+    profiler().record(name, start, profiler().now());
+}
+
+
+#endif /* __PROFILE_H__ */
@@ -0,0 +1,267 @@
+#ifndef __RESAMPLE_H__
+#define __RESAMPLE_H__
+
+#include <vector>
+#include <cmath>
+#include "bitmap.h"
+using namespace std;
+
+enum ResampleFilter { BOX, BILINEAR, LANCZOS3 };
+
+/*
+Resampler
+
+separable resize, horizontal pass into an 8-bit intermediate then a
+vertical pass. The weights of every output column and row are computed
+once (Q14) when the sizes change, so resizing a stream of frames to the
+same size only runs the two weighted sums.
+When shrinking, the filter is stretched by the scale so every source
+pixel contributes.
+*/
+class Resampler {
+public:
+    Resampler(ResampleFilter filter);
+    bool resize(Bitmap& src, Bitmap& dst, int width, int height);
+private:
+    static const int FIX = 14;
+    // contributions of one axis: output i reads `count` pixels from first[i]
+    struct Axis {
+        int src, dst;
+        vector<int> first;
+        vector<int> weights; // dst * count
+        int count;
+    };
+    ResampleFilter filter;
+    Axis ax, ay;
+    vector<unsigned char> tmp;
+    vector<int> acc;
+    double support();
+    double weight(double t);
+    void prepare(Axis& a, int src, int dst);
+};
+
+/*
+MipPyramid
+
+every 2x box-downsampled level of a bitmap, until a side reaches 1, built in one
+pass over the source: each pair of rows finished on one level is
+averaged into the next level right away, while it is still in cache.
+Odd last rows and columns are dropped.
+*/
+class MipPyramid {
+public:
+    MipPyramid();
+    MipPyramid(Bitmap& src, int count);
+    ~MipPyramid();
+    void build(Bitmap& src, int count); // count = 0 builds every level
+    int size();                         // number of levels
+    Bitmap& level(int i);               // level i is 2^(i+1) times smaller
+    void clear();
+private:
+    vector<Bitmap*> levels;
+    vector<int> rows;   // rows finished per level
+    void emit(int i, const RGB *a, const RGB *b); // average two rows into level i
+    MipPyramid(const MipPyramid&);
+    MipPyramid& operator=(const MipPyramid&);
+};
+
+bool resize(Bitmap& src, Bitmap& dst, int width, int height, ResampleFilter filter); // one-off resize
+
+
+/******************************************************************************/
+//  Resampler Member Functions
+/******************************************************************************/
+
+Resampler::Resampler(ResampleFilter filter) {
+    this->filter = filter;
+    ax.src = ax.dst = ay.src = ay.dst = 0;
+}
+
+bool Resampler::resize(Bitmap& src, Bitmap& dst, int width, int height) {
+    int sw = src.getWidth(), sh = src.getHeight();
+    if(width <= 0 || height <= 0 || sw <= 0 || sh <= 0)
+        return false;
+    if(dst.getWidth() != width || dst.getHeight() != height)
+        if(!dst.setSize(width, height))
+            return false;
+    prepare(ax, sw, width);
+    prepare(ay, sh, height);
+    // horizontal: sh x width
+    tmp.resize(sh * width * 3);
+    for(int y = 0; y < sh; y++) {
+        const unsigned char *row = (const unsigned char*)src.row(y);
+        unsigned char *t = &tmp[y * width * 3];
+        for(int x = 0; x < width; x++) {
+            const int *w = &ax.weights[x * ax.count];
+            const unsigned char *p = row + ax.first[x] * 3;
+            int B = 1 << (FIX - 1), G = B, R = B;
+            for(int i = 0; i < ax.count; i++)
+                B += w[i] * p[i * 3], G += w[i] * p[i * 3 + 1], R += w[i] * p[i * 3 + 2];
+            B >>= FIX, G >>= FIX, R >>= FIX;
+            t[x * 3] = (unsigned char)(B < 0 ? 0 : (B > 255 ? 255 : B));
+            t[x * 3 + 1] = (unsigned char)(G < 0 ? 0 : (G > 255 ? 255 : G));
+            t[x * 3 + 2] = (unsigned char)(R < 0 ? 0 : (R > 255 ? 255 : R));
+        }
+    }
+    // vertical: whole rows at a time
+    int n = width * 3;
+    acc.resize(n);
+    for(int y = 0; y < height; y++) {
+        const int *w = &ay.weights[y * ay.count];
+        for(int c = 0; c < n; c++)
+            acc[c] = 1 << (FIX - 1);
+        for(int i = 0; i < ay.count; i++) {
+            if(w[i] == 0)
+                continue;
+            const unsigned char *t = &tmp[(ay.first[y] + i) * n];
+            for(int c = 0; c < n; c++)
+                acc[c] += w[i] * t[c];
+        }
+        unsigned char *out = (unsigned char*)dst.row(y);
+        for(int c = 0; c < n; c++) {
+            int v = acc[c] >> FIX;
+            out[c] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+    }
+    return true;
+}
+
+double Resampler::support() {
+    switch(filter) {
+        case BOX: return 0.5;
+        case BILINEAR: return 1.0;
+        default: return 3.0;
+    }
+}
+
+double Resampler::weight(double t) {
+    t = fabs(t);
+    switch(filter) {
+        case BOX:
+            return t <= 0.5 ? 1.0 : 0.0;
+        case BILINEAR:
+            return t < 1.0 ? 1.0 - t : 0.0;
+        default:
+            if(t < 1e-8)
+                return 1.0;
+            if(t >= 3.0)
+                return 0.0;
+            return 3.0 * sin(3.1415926535 * t) * sin(3.1415926535 * t / 3.0) / (3.1415926535 * 3.1415926535 * t * t);
+    }
+}
+
+void Resampler::prepare(Axis& a, int src, int dst) {
+    if(a.src == src && a.dst == dst)
+        return;
+    a.src = src, a.dst = dst;
+    double scale = double(src) / dst, stretch = scale > 1 ? scale : 1;
+    double r = support() * stretch;
+    a.count = int(ceil(r)) * 2 + 1;
+    if(a.count > src)
+        a.count = src;
+    a.first.assign(dst, 0);
+    a.weights.assign(dst * a.count, 0);
+    vector<double> w(a.count);
+    for(int i = 0; i < dst; i++) {
+        double center = (i + 0.5) * scale - 0.5;
+        int first = int(floor(center - r + 0.5));
+        if(first < 0)
+            first = 0;
+        if(first + a.count > src)
+            first = src - a.count;
+        double sum = 0;
+        for(int k = 0; k < a.count; k++)
+            sum += w[k] = weight((first + k - center) / stretch);
+        // pixels past the border fold back onto the edge pixel
+        int lo = int(floor(center - r + 0.5)), hi = int(floor(center + r + 0.5));
+        for(int p = lo; p <= hi; p++) {
+            if(p >= 0 && p < src)
+                continue;
+            double e = weight((p - center) / stretch);
+            w[p < 0 ? 0 : a.count - 1] += e, sum += e;
+        }
+        a.first[i] = first;
+        int total = 0, big = 0;
+        for(int k = 0; k < a.count; k++) {
+            int q = int(floor(w[k] / sum * (1 << FIX) + 0.5));
+            a.weights[i * a.count + k] = q, total += q;
+            if(w[k] > w[big])
+                big = k;
+        }
+        a.weights[i * a.count + big] += (1 << FIX) - total; // weights sum to exactly 1
+    }
+}
+
+
+/******************************************************************************/
+//  MipPyramid Member Functions
+/******************************************************************************/
+
+MipPyramid::MipPyramid() {}
+
+MipPyramid::MipPyramid(Bitmap& src, int count = 0) {
+    build(src, count);
+}
+
+MipPyramid::~MipPyramid() {
+    clear();
+}
+
+// count = 0 builds every level
+void MipPyramid::build(Bitmap& src, int count = 0) {
+    clear();
+    int w = src.getWidth() / 2, h = src.getHeight() / 2;
+    while(w > 0 && h > 0 && (count <= 0 || int(levels.size()) < count)) {
+        levels.push_back(new Bitmap(w, h));
+        w /= 2, h /= 2;
+    }
+    rows.assign(levels.size(), 0);
+    if(levels.empty())
+        return;
+    for(int y = 0; y + 1 < src.getHeight(); y += 2)
+        emit(0, src.row(y), src.row(y + 1));
+}
+
+// number of levels
+int MipPyramid::size() {
+    return levels.size();
+}
+
+// level i is 2^(i+1) times smaller
+Bitmap& MipPyramid::level(int i) {
+    return *levels[i];
+}
+
+void MipPyramid::clear() {
+    for(int i = 0; i < int(levels.size()); i++)
+        delete levels[i];
+    levels.clear();
+    rows.clear();
+}
+
+// average two rows into level i
+void MipPyramid::emit(int i, const RGB *a, const RGB *b) {
+    Bitmap& l = *levels[i];
+    int w = l.getWidth();
+    if(rows[i] >= l.getHeight())
+        return;
+    RGB *row = l.row(rows[i]);
+    const unsigned char *p = (const unsigned char*)a, *q = (const unsigned char*)b;
+    unsigned char *d = (unsigned char*)row;
+    for(int x = 0; x < w; x++)
+        for(int c = 0; c < 3; c++)
+            d[x * 3 + c] = (unsigned char)((p[x * 6 + c] + p[x * 6 + 3 + c] + q[x * 6 + c] + q[x * 6 + 3 + c] + 2) >> 2);
+    rows[i]++;
+    if(rows[i] % 2 == 0 && i + 1 < int(levels.size()))
+        emit(i + 1, l.row(rows[i] - 2), l.row(rows[i] - 1));
+}
+
+
+// one-off resize
+bool resize(Bitmap& src, Bitmap& dst, int width, int height, ResampleFilter filter = BILINEAR) {
+    Resampler r(filter);
+    return r.resize(src, dst, width, height);
+}
+
+
+#endif /* __RESAMPLE_H__ */
@@ -0,0 +1,53 @@
+#ifndef __SCRATCH_H__
+#define __SCRATCH_H__
+
+#include <vector>
+#include <cstddef>
+using namespace std;
+
+/*
+ScratchPool
+
+numbered scratch buffers that only grow, so repeated filter calls
+reuse the same memory instead of allocating a frame each time
+growing one slot never moves the others
+*/
+class ScratchPool {
+public:
+    ScratchPool();
+    template<class T> T *get(int slot, int count); // slot grown to at least count T
+    void clear();           // free all buffers
+    size_t bytes();         // memory held
+private:
+    static const int SLOTS = 8;
+    vector<double> slots[SLOTS];    // double keeps every slot 8-byte aligned
+};
+
+
+ScratchPool::ScratchPool() {}
+
+// slot grown to at least count T
+template<class T>
+T *ScratchPool::get(int slot, int count) {
+    size_t n = (sizeof(T) * count + sizeof(double) - 1) / sizeof(double);
+    if(slots[slot].size() < n)
+        slots[slot].resize(n);
+    return slots[slot].empty() ? NULL : (T*)&slots[slot][0];
+}
+
+// free all buffers
+void ScratchPool::clear() {
+    for(int i = 0; i < SLOTS; i++)
+        vector<double>().swap(slots[i]);
+}
+
+// memory held
+size_t ScratchPool::bytes() {
+    size_t n = 0;
+    for(int i = 0; i < SLOTS; i++)
+        n += slots[i].capacity() * sizeof(double);
+    return n;
+}
+
+
+#endif /* __SCRATCH_H__ */
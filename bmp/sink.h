@@ -0,0 +1,334 @@
+#ifndef __SINK_H__
+#define __SINK_H__
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+#include "bitmap.h"
+using namespace std;
+
+/*
+frame sinks
+
+where finished frames go, one write() per frame
+
+    BmpSink     numbered .bmp files through Bitmap::save
+    RawSink     top-down BGR24 rows, straight from the bitmap's buffer
+    Y4MSink     YUV4MPEG2 4:2:0, full range BT.601 (C420jpeg)
+
+RawSink and Y4MSink write to a file descriptor: one given by the caller
+(a pipe to an encoder, a socket), or a path they open themselves, which
+may be a named pipe; "-" is stdout. Either way nothing touches the disk
+unless the path is a file:
+
+    render | ffmpeg -f yuv4mpegpipe -i - out.mp4
+    ffmpeg -f rawvideo -pix_fmt bgr24 -s 640x480 -r 30 -i - out.mp4
+
+on Windows, which has no writev, the descriptor goes through a FILE and
+fwrite, stdout switched to binary
+*/
+class FrameSink {
+public:
+    virtual ~FrameSink() {}
+    virtual bool write(Bitmap& frame) = 0;
+    virtual bool close() { return true; }
+    int getFrames() { return frames; }      // written so far
+protected:
+    int frames = 0;
+};
+
+class BmpSink : public FrameSink {
+public:
+    BmpSink(const char *pattern);           // printf pattern with the frame number, "f%04d.bmp"
+    bool write(Bitmap& frame);
+private:
+    string pattern;
+};
+
+/*
+StreamSink
+
+a file descriptor and the writes that finish what they start
+*/
+class StreamSink : public FrameSink {
+public:
+    ~StreamSink();
+    bool isOpen();
+    bool close();
+protected:
+    int fd;
+    bool owner;                             // fd is ours to close
+#ifdef _WIN32
+    FILE *file;                             // fd through the C library
+#endif
+    StreamSink(int fd);
+    StreamSink(const char *name);           // "-" for stdout
+    bool put(const void *data, size_t n);
+    bool putRows(Bitmap& frame);            // rows top-down, from the buffer itself
+};
+
+class RawSink : public StreamSink {
+public:
+    RawSink(int fd);
+    RawSink(const char *name);
+    bool write(Bitmap& frame);
+};
+
+class Y4MSink : public StreamSink {
+public:
+    Y4MSink(int fd, int fps);
+    Y4MSink(const char *name, int fps);
+    bool write(Bitmap& frame);              // every frame the size of the first
+private:
+    int fps, width, height;
+    vector<unsigned char> yuv;              // "FRAME\n" and the three planes, reused
+    vector<unsigned short> sums;            // bgrToYUV420 scratch, reused
+};
+
+void bgrToYUV420(Bitmap& bmp, unsigned char *Y, unsigned char *U, unsigned char *V,
+                 vector<unsigned short>& sums);     // top-down planes, chroma (w + 1) / 2 x (h + 1) / 2
+void lumaRow(const unsigned char *__restrict s, unsigned char *__restrict d, int w);    // one row of luma from BGR24
+void sumRows(const unsigned char *__restrict a, const unsigned char *__restrict b,
+             unsigned short *__restrict B, unsigned short *__restrict G, unsigned short *__restrict R, int w);  // two rows added up
+void chromaRow(const unsigned short *__restrict B, const unsigned short *__restrict G, const unsigned short *__restrict R,
+               unsigned char *__restrict u, unsigned char *__restrict v, int n);            // n chroma pairs from row sums
+
+
+/******************************************************************************/
+//  BmpSink Member Functions
+/******************************************************************************/
+
+// printf pattern with the frame number, "f%04d.bmp"
+BmpSink::BmpSink(const char *pattern) {
+    this->pattern = pattern;
+}
+
+bool BmpSink::write(Bitmap& frame) {
+    char name[1024];
+    snprintf(name, sizeof(name), pattern.c_str(), frames);
+    frames++;
+    return frame.save(name);
+}
+
+
+/******************************************************************************/
+//  StreamSink Member Functions
+/******************************************************************************/
+
+StreamSink::StreamSink(int fd) {
+    this->fd = fd, owner = false;
+#ifdef _WIN32
+    file = NULL;
+    if(fd >= 0 && _setmode(fd, _O_BINARY) != -1)
+        file = _fdopen(fd, "wb");
+    if(!file)
+        this->fd = -1;
+#endif
+}
+
+// "-" for stdout
+StreamSink::StreamSink(const char *name) {
+#ifdef _WIN32
+    if(string(name) == "-")
+        file = stdout, owner = false, _setmode(_fileno(stdout), _O_BINARY);
+    else
+        file = fopen(name, "wb"), owner = true;
+    fd = file ? _fileno(file) : -1;
+#else
+    if(string(name) == "-")
+        fd = 1, owner = false;
+    else
+        fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644), owner = true;
+#endif
+}
+
+StreamSink::~StreamSink() {
+    close();
+}
+
+bool StreamSink::isOpen() {
+    return fd >= 0;
+}
+
+bool StreamSink::close() {
+    bool ok = true;
+#ifdef _WIN32
+    if(file) // a FILE on someone else's descriptor is only flushed
+        ok = (owner ? fclose(file) : fflush(file)) == 0;
+    file = NULL;
+#else
+    if(owner && fd >= 0)
+        ok = ::close(fd) == 0;
+#endif
+    fd = -1;
+    return ok;
+}
+
+bool StreamSink::put(const void *data, size_t n) {
+#ifdef _WIN32
+    return file && fwrite(data, 1, n, file) == n;
+#else
+    const char *p = (const char*)data;
+    while(n > 0) {
+        ssize_t k = ::write(fd, p, n);
+        if(k < 0 && errno == EINTR)
+            continue;
+        if(k <= 0)
+            return false;
+        p += k, n -= k;
+    }
+    return true;
+#endif
+}
+
+// rows top-down, from the buffer itself
+// up to 64 rows per writev; a short write is finished row by row
+// without writev one fwrite per row, which the FILE buffers
+bool StreamSink::putRows(Bitmap& frame) {
+    if(fd < 0)
+        return false;
+    size_t bytes = frame.getWidth() * sizeof(RGB);
+#ifdef _WIN32
+    for(int y = frame.getHeight() - 1; y >= 0; y--)
+        if(!put(frame.row(y), bytes))
+            return false;
+#else
+    struct iovec io[64];
+    for(int top = 0; top < frame.getHeight(); top += 64) {
+        int n = min(64, frame.getHeight() - top);
+        for(int i = 0; i < n; i++)
+            io[i].iov_base = frame.row(frame.getHeight() - 1 - top - i), io[i].iov_len = bytes;
+        ssize_t k = writev(fd, io, n);
+        if(k < 0 && errno != EINTR)
+            return false;
+        size_t done = k < 0 ? 0 : k;
+        for(int i = 0; i < n; i++) {
+            size_t skip = min(done, bytes);
+            done -= skip;
+            if(skip < bytes && !put((char*)io[i].iov_base + skip, bytes - skip))
+                return false;
+        }
+    }
+#endif
+    return true;
+}
+
+
+/******************************************************************************/
+//  RawSink Member Functions
+/******************************************************************************/
+
+RawSink::RawSink(int fd) : StreamSink(fd) {}
+
+RawSink::RawSink(const char *name) : StreamSink(name) {}
+
+bool RawSink::write(Bitmap& frame) {
+    frames++;
+    return putRows(frame);
+}
+
+
+/******************************************************************************/
+//  Y4MSink Member Functions
+/******************************************************************************/
+
+Y4MSink::Y4MSink(int fd, int fps = 30) : StreamSink(fd) {
+    this->fps = fps, width = height = 0;
+}
+
+Y4MSink::Y4MSink(const char *name, int fps = 30) : StreamSink(name) {
+    this->fps = fps, width = height = 0;
+}
+
+// every frame the size of the first
+bool Y4MSink::write(Bitmap& frame) {
+    if(fd < 0)
+        return false;
+    if(frames == 0) {
+        width = frame.getWidth(), height = frame.getHeight();
+        char header[96];
+        int n = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+        if(!put(header, n))
+            return false;
+        size_t luma = size_t(width) * height, chroma = size_t((width + 1) / 2) * ((height + 1) / 2);
+        yuv.assign(6 + luma + 2 * chroma, 0);
+        copy_n("FRAME\n", 6, yuv.begin());
+    }
+    if(frame.getWidth() != width || frame.getHeight() != height)
+        return false;
+    size_t luma = size_t(width) * height, chroma = size_t((width + 1) / 2) * ((height + 1) / 2);
+    unsigned char *Y = &yuv[6];
+    bgrToYUV420(frame, Y, Y + luma, Y + luma + chroma, sums);
+    frames++;
+    return put(&yuv[0], yuv.size());
+}
+
+
+/******************************************************************************/
+//  Conversion
+/******************************************************************************/
+
+// one row of luma from BGR24
+void lumaRow(const unsigned char *__restrict s, unsigned char *__restrict d, int w) {
+    for(int x = 0; x < w; x++)
+        d[x] = (unsigned char)((29 * s[x * 3] + 150 * s[x * 3 + 1] + 77 * s[x * 3 + 2] + 128) >> 8);
+}
+
+// two rows added up, one plane per channel
+void sumRows(const unsigned char *__restrict a, const unsigned char *__restrict b,
+             unsigned short *__restrict B, unsigned short *__restrict G, unsigned short *__restrict R, int w) {
+    for(int x = 0; x < w; x++) {
+        B[x] = a[x * 3] + b[x * 3];
+        G[x] = a[x * 3 + 1] + b[x * 3 + 1];
+        R[x] = a[x * 3 + 2] + b[x * 3 + 2];
+    }
+}
+
+// n chroma pairs from row sums, two columns each
+// the inputs are sums of 4, so >> 10 instead of >> 8; 0.5 * 255 + 128
+// rounds to 256 and is clamped
+void chromaRow(const unsigned short *__restrict B, const unsigned short *__restrict G, const unsigned short *__restrict R,
+               unsigned char *__restrict u, unsigned char *__restrict v, int n) {
+    for(int x = 0; x < n; x++) {
+        int b = B[2 * x] + B[2 * x + 1], g = G[2 * x] + G[2 * x + 1], r = R[2 * x] + R[2 * x + 1];
+        int cu = ((-43 * r - 85 * g + 128 * b + 512) >> 10) + 128;
+        int cv = ((128 * r - 107 * g - 21 * b + 512) >> 10) + 128;
+        u[x] = (unsigned char)(cu < 255 ? cu : 255), v[x] = (unsigned char)(cv < 255 ? cv : 255);
+    }
+}
+
+// top-down planes, chroma (w + 1) / 2 x (h + 1) / 2
+// fixed point JFIF coefficients, chroma from the mean of each 2 x 2
+// block, the last row or column repeated when the size is odd
+// the row kernels are branch-free loops over restrict pointers that the
+// compiler vectorizes once it may use byte shuffles for the 3-byte
+// pixels: -O3 with -mssse3 or newer (-march=native)
+// sums is the row-sum scratch, grown to 3 (w + 1) on first use
+void bgrToYUV420(Bitmap& bmp, unsigned char *Y, unsigned char *U, unsigned char *V, vector<unsigned short>& sums) {
+    int w = bmp.getWidth(), h = bmp.getHeight(), cw = (w + 1) / 2;
+    if(w <= 0 || h <= 0)
+        return;
+    for(int y = 0; y < h; y++)
+        lumaRow((const unsigned char*)bmp.row(h - 1 - y), Y + size_t(y) * w, w);
+    if(sums.size() < size_t(3 * (w + 1)))
+        sums.resize(3 * (w + 1));
+    unsigned short *B = &sums[0], *G = B + w + 1, *R = G + w + 1;
+    for(int cy = 0; cy < (h + 1) / 2; cy++) {
+        const unsigned char *a = (const unsigned char*)bmp.row(h - 1 - 2 * cy);
+        const unsigned char *b = (const unsigned char*)bmp.row(max(h - 2 - 2 * cy, 0));
+        sumRows(a, b, B, G, R, w);
+        B[w] = B[w - 1], G[w] = G[w - 1], R[w] = R[w - 1];
+        chromaRow(B, G, R, U + size_t(cy) * cw, V + size_t(cy) * cw, cw);
+    }
+}
+
+
+#endif /* __SINK_H__ */
@@ -0,0 +1,207 @@
+#ifndef __TASKGRAPH_H__
+#define __TASKGRAPH_H__
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+using namespace std;
+
+/*
+TaskGraph
+
+tasks with explicit dependencies, run on a fixed set of worker threads
+as soon as everything they come after has finished
+
+    int load = graph.add(...);
+    int shot = graph.add(..., load);
+    int save = graph.add(..., { shot, lastSave });  // saves stay in order
+    graph.wait();
+
+a task may only come after tasks added before it, so the graph can be
+built while it runs: a producer adds the stages of frame n + 1 while
+workers still blur frame n and write frame n - 1. At most `capacity`
+tasks are unfinished at a time; add() blocks until one finishes, which
+bounds the memory held by frames in flight.
+
+tasks may add tasks too. A task never blocks in add(): while the graph
+is full it runs ready tasks itself, and if none is ready it adds past
+capacity, since waiting could leave every worker waiting on the others.
+wait() is for threads outside the graph: in a task it would wait on
+itself.
+
+deterministic: no worker threads, every task runs on the thread that
+calls add() (when it has to make room) or wait(), in the order the
+tasks became ready, so a run is repeatable for tests.
+
+ids are handed out in order from 0 and stay valid for the life of the
+graph; finished tasks are dropped from the front.
+*/
+class TaskGraph {
+public:
+    TaskGraph(int threads, int capacity, bool deterministic);  // threads 0: one per hardware thread
+    ~TaskGraph();                                   // waits for every task
+    int add(function<void()> task);
+    int add(function<void()> task, int after);      // after < 0: nothing
+    int add(function<void()> task, const vector<int>& after);
+    void wait();                                    // until every task added so far has run
+    int getThreads();                               // 0 when deterministic
+private:
+    struct Node {
+        function<void()> task;
+        vector<int> next;           // tasks waiting for this one
+        int waiting;                // unfinished tasks this one comes after
+        bool done;
+    };
+    deque<Node> nodes;              // ids base .. base + size - 1
+    deque<int> ready;
+    int base, pending, capacity;
+    bool deterministic, stopping;
+    mutex lock;
+    condition_variable readyCv, spaceCv, doneCv;
+    vector<thread> workers;
+    void work();                                    // worker loop
+    void runOne(unique_lock<mutex>& held);          // first ready task, on this thread
+    static TaskGraph*& running();                   // graph of the task this thread is in, NULL outside one
+    void finish(int id);                            // lock held
+};
+
+
+/******************************************************************************/
+//  TaskGraph Member Functions
+/******************************************************************************/
+
+// threads 0: one per hardware thread
+TaskGraph::TaskGraph(int threads = 0, int capacity = 64, bool deterministic = false) {
+    base = pending = 0;
+    this->capacity = max(capacity, 1);
+    this->deterministic = deterministic;
+    stopping = false;
+    if(threads <= 0)
+        threads = max(int(thread::hardware_concurrency()), 1);
+    if(!deterministic)
+        for(int i = 0; i < threads; i++)
+            workers.push_back(thread(&TaskGraph::work, this));
+}
+
+// waits for every task
+TaskGraph::~TaskGraph() {
+    wait();
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    readyCv.notify_all();
+    for(int i = 0; i < int(workers.size()); i++)
+        workers[i].join();
+}
+
+int TaskGraph::add(function<void()> task) {
+    return add(task, vector<int>());
+}
+
+// after < 0: nothing
+int TaskGraph::add(function<void()> task, int after) {
+    return add(task, after < 0 ? vector<int>() : vector<int>(1, after));
+}
+
+int TaskGraph::add(function<void()> task, const vector<int>& after) {
+    unique_lock<mutex> held(lock);
+    bool inside = running() == this;
+    while(pending >= capacity)
+        if(deterministic || inside) {
+            if(ready.empty())   // only in a task: the rest are running or wait on them
+                break;
+            runOne(held);
+        } else
+            spaceCv.wait(held);
+    int id = base + nodes.size();
+    Node node;
+    node.task = task;
+    node.waiting = 0;
+    node.done = false;
+    nodes.push_back(node);
+    for(int i = 0; i < int(after.size()); i++) {
+        int d = after[i];
+        if(d >= base && d < id && !nodes[d - base].done)
+            nodes[d - base].next.push_back(id), nodes.back().waiting++;
+    }
+    pending++;
+    if(nodes.back().waiting == 0) {
+        ready.push_back(id);
+        readyCv.notify_one();
+    }
+    return id;
+}
+
+// until every task added so far has run
+void TaskGraph::wait() {
+    unique_lock<mutex> held(lock);
+    if(deterministic)
+        while(pending > 0)
+            runOne(held);
+    else
+        doneCv.wait(held, [this] { return pending == 0; });
+}
+
+// 0 when deterministic
+int TaskGraph::getThreads() {
+    return workers.size();
+}
+
+// worker loop
+void TaskGraph::work() {
+    unique_lock<mutex> held(lock);
+    for(;;) {
+        readyCv.wait(held, [this] { return stopping || !ready.empty(); });
+        if(ready.empty())
+            return;
+        runOne(held);
+    }
+}
+
+// first ready task, on this thread
+void TaskGraph::runOne(unique_lock<mutex>& held) {
+    int id = ready.front();
+    ready.pop_front();
+    function<void()> task;
+    task.swap(nodes[id - base].task);   // its captures are freed when it returns
+    held.unlock();
+    TaskGraph *outer = running();
+    running() = this;
+    task();
+    running() = outer;
+    task = nullptr;
+    held.lock();
+    finish(id);
+}
+
+// graph of the task this thread is in, NULL outside one
+TaskGraph*& TaskGraph::running() {
+    static thread_local TaskGraph *graph = NULL;
+    return graph;
+}
+
+// lock held
+void TaskGraph::finish(int id) {
+    Node &node = nodes[id - base];
+    node.done = true;
+    for(int i = 0; i < int(node.next.size()); i++)
+        if(--nodes[node.next[i] - base].waiting == 0) {
+            ready.push_back(node.next[i]);
+            readyCv.notify_one();
+        }
+    vector<int>().swap(node.next);
+    while(!nodes.empty() && nodes.front().done)
+        nodes.pop_front(), base++;
+    pending--;
+    spaceCv.notify_one();
+    if(pending == 0)
+        doneCv.notify_all();
+}
+
+
+#endif /* __TASKGRAPH_H__ */
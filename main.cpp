@@ -1,24 +1,51 @@
 #include "bmp/include.h"
 
-#define INPUT "bpt\\teapotCGAtall.bpt"
-#define OUTPUT "output\\output.bmp"
+/*
+render [-j threads] [-d] [jobs.txt]
 
-int main() {
-    Bitmap bitmap(640, 480);
-    Camera cam; cam.zoom = 1, cam.focus = 10000, cam.height = 100;
-    BezObj teapot(INPUT);
-    teapot.move(P3(0, -100, -1000));
-    teapot.rotateZ(-45);
-    teapot.rotateX(-45);
-    teapot.split(2);
-    cam.shot(teapot, bitmap);
-    ImageProcessor ip(&bitmap);
-    ip.rerange(
-        P2(-320, -240),
-        P2(0, 0)
-    );
-    ip.GaussianBlur(2);
-    bitmap.save(OUTPUT);
-    system(OUTPUT);
-    return 0;
+renders every job of the file (see bmp/batch.h for the format) on a pool
+of worker threads and prints the timings of each; without a job file it
+renders the teapot to output/output.bmp. -d runs every stage on the main
+thread in a fixed order
+*/
+#define DEFAULT_JOB "model=bpt/teapotCGAtall.bpt out=output/output.bmp size=640x480 split=2 " \
+    "rotz=-45 rotx=-45 move=0,-100,-1000 zoom=1 focus=10000 height=100 aa"
+
+int main(int argc, char **argv) {
+    int threads = 0;
+    bool deterministic = false;
+    const char *file = NULL;
+    for(int i = 1; i < argc; i++)
+        if(string(argv[i]) == "-j" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if(string(argv[i]) == "-d")
+            deterministic = true;
+        else
+            file = argv[i];
+    vector<RenderJob> jobs;
+    string error;
+    if(!file) {
+        jobs.push_back(RenderJob());
+        jobs[0].parse(DEFAULT_JOB, error);
+    } else if(!readJobs(file, jobs, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 2;
+    }
+    BatchRenderer renderer(threads);
+    renderer.deterministic = deterministic;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    renderer.run(jobs);
+    double wall = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    int failed = 0;
+    printf("%6s %9s %9s %9s %9s %9s  %s\n", "line", "load ms", "render ms", "filter ms", "save ms", "total ms", "output");
+    for(int i = 0; i < int(jobs.size()); i++) {
+        RenderJob &j = jobs[i];
+        printf("%6d %9.2f %9.2f %9.2f %9.2f %9.2f  %s", j.line, j.loadMs, j.renderMs, j.filterMs, j.saveMs, j.totalMs, j.out.c_str());
+        if(!j.ok)
+            printf("  FAILED: %s", j.error.c_str()), failed++;
+        printf("\n");
+    }
+    printf("%d jobs, %d failed, %d threads, %d models cached, %.1f ms (%.1f jobs/s)\n", int(jobs.size()), failed,
+        renderer.getThreads(), int(renderer.models.size()), wall, jobs.size() * 1000.0 / wall);
+    return failed ? 1 : 0;
 }